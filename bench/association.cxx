@@ -0,0 +1,125 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#include "corpus.h"
+
+#include "driver/program.h"
+#include "utils/stats.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace clomp;
+using namespace clomp::bench;
+
+/*
+ * Measures how the time spent associating the pragmas to the AST grows with the number 
+ * of pragmas of a function, with the length of the blocks between the pragmas, with 
+ * the nesting depth of the blocks and with the number of pragmas closing each block 
+ * (which are attached by rebuilding the block, see the rebuilds column). Each knob is 
+ * doubled in turn while the others keep their base value; the growth exponent of a step
+ * is log2 of the ratio between the association times, 1 for a linear and 2 for a 
+ * quadratic growth.
+ */
+
+namespace {
+
+struct Point {
+	unsigned pragmas, blockLength, depth, trailing;
+};
+
+/*
+ * Returns the best (minimum) statistics of repeat runs on a dense function
+ */
+ParseStats measure(const Point& pt, unsigned repeat) {
+	const VirtualFile input("dense.c", generateDenseFunction(pt.pragmas, pt.blockLength, pt.depth, pt.trailing));
+
+	CompilerOptions options;
+	options.collectStats = true;
+
+	ParseStats best;
+	for (unsigned i = 0; i < repeat; ++i) {
+		TranslationUnit tu(input, options);
+		const ParseStats& cur = tu.getStats();
+		if (i == 0 || cur.semaTime < best.semaTime) { best = cur; }
+	}
+	return best;
+}
+
+} // end anonymous namespace
+
+void usage(const char* prog) {
+	std::cerr << "usage: " << prog << " [options]" << std::endl
+			  << std::endl
+			  << "  --pragmas <n>       base number of pragmas of the function (default 64)" << std::endl
+			  << "  --block <n>         base number of statements following each pragma (default 4)" << std::endl
+			  << "  --depth <n>         base nesting depth of the blocks (default 2)" << std::endl
+			  << "  --trailing <n>      base number of barrier/flush pragmas closing each block (default 1)" << std::endl
+			  << "  --steps <n>         number of times each knob is doubled (default 5)" << std::endl
+			  << "  --repeat <n>        runs of each point, the fastest one is reported (default 3)" << std::endl
+			  << "  --max-exponent <x>  fail if the growth exponent of a step exceeds x" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+
+	Point base = { 64, 4, 2, 1 };
+	unsigned steps = 5, repeat = 3;
+	double maxExponent = 0;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg(argv[i]);
+		if (i+1 == argc) {
+			usage(argv[0]);
+			return 1;
+		}
+		if (arg == "--pragmas") 			{ base.pragmas = atoi(argv[++i]); }
+		else if (arg == "--block") 			{ base.blockLength = atoi(argv[++i]); }
+		else if (arg == "--depth") 			{ base.depth = std::max(atoi(argv[++i]), 1); }
+		else if (arg == "--trailing") 		{ base.trailing = atoi(argv[++i]); }
+		else if (arg == "--steps") 			{ steps = atoi(argv[++i]); }
+		else if (arg == "--repeat") 		{ repeat = std::max(atoi(argv[++i]), 1); }
+		else if (arg == "--max-exponent") 	{ maxExponent = atof(argv[++i]); }
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	const char* const names[] = { "pragmas", "block", "depth", "trailing" };
+	unsigned Point::* const knobs[] = { &Point::pragmas, &Point::blockLength, &Point::depth, &Point::trailing };
+
+	std::cout << std::left << std::setw(10) << "knob" << std::setw(10) << "value" 
+			  << std::setw(12) << "parse ms" << std::setw(12) << "assoc ms" 
+			  << std::setw(12) << "rebuilds" << "exponent" << std::endl;
+
+	bool failed = false;
+	for (unsigned k = 0; k < 4; ++k) {
+		Point pt = base;
+		double prevTime = 0;
+		for (unsigned s = 0; s <= steps; ++s) {
+			const ParseStats&& stats = measure(pt, repeat);
+
+			std::cout << std::setw(10) << names[k] << std::setw(10) << pt.*knobs[k] << std::fixed << std::setprecision(3)
+					  << std::setw(12) << stats.parseTime * 1e3 << std::setw(12) << stats.semaTime * 1e3 
+					  << std::setw(12) << stats.compoundRebuilds;
+			if (s > 0 && prevTime > 0 && stats.semaTime > 0) {
+				const double exponent = std::log2(stats.semaTime / prevTime);
+				std::cout << std::setprecision(2) << exponent;
+				if (maxExponent > 0 && exponent > maxExponent) {
+					std::cout << " (exceeds " << maxExponent << ")";
+					failed = true;
+				}
+			}
+			std::cout << std::endl;
+
+			prevTime = stats.semaTime;
+			pt.*knobs[k] *= 2;
+		}
+	}
+	return failed ? 1 : 0;
+}
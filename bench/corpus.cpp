@@ -0,0 +1,208 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#include "corpus.h"
+
+#include <sstream>
+#include <fstream>
+#include <stdexcept>
+#include <cstdlib>
+
+namespace {
+
+using namespace clomp::bench;
+
+// clauses taking a list of variables, followed by those which do not
+const char* const parallelListClauses[] = { "private", "firstprivate", "shared", "reduction" };
+const char* const parallelOtherClauses[] = { "num_threads(4)", "if(n > 64)", "default(shared)" };
+const char* const forListClauses[] = { "private", "firstprivate", "lastprivate", "reduction" };
+const char* const forOtherClauses[] = { "schedule(dynamic, 8)", "nowait" };
+
+const unsigned numListClauses = 4;
+
+std::string indent(unsigned level) { return std::string(level, '\t'); }
+
+/*
+ * Writes the clauses of a pragma, the k-th clause lists the variables [k*len, (k+1)*len)
+ */
+void writeClauses(std::ostream& out, const CorpusShape& shape, bool parallel) {
+	const char* const* listClauses = parallel ? parallelListClauses : forListClauses;
+	const char* const* otherClauses = parallel ? parallelOtherClauses : forOtherClauses;
+	const unsigned numOtherClauses = parallel ? 3 : 2;
+
+	for (unsigned k = 0; k < shape.clauses; ++k) {
+		if (k >= numListClauses && k < numListClauses + numOtherClauses) {
+			out << " " << otherClauses[k - numListClauses];
+			continue;
+		}
+		const char* clause = listClauses[(k < numListClauses ? k : k - numOtherClauses) % numListClauses];
+		out << " " << clause << "(";
+		if (clause == std::string("reduction")) { out << "+: "; }
+		for (unsigned i = 0; i < shape.varListLength; ++i) {
+			out << (i ? ", " : "") << "v" << k * shape.varListLength + i;
+		}
+		out << ")";
+	}
+}
+
+/*
+ * Writes a region made of numPragmas nested pragmas: even levels are parallel regions,
+ * odd levels are worksharing loops
+ */
+void writeRegion(std::ostream& out, const CorpusShape& shape, unsigned level, unsigned numPragmas) {
+	const bool parallel = level % 2 == 0;
+	const unsigned tabs = level + 1;
+
+	out << "#pragma omp " << (parallel ? "parallel" : "for");
+	writeClauses(out, shape, parallel);
+	out << "\n";
+	if (!parallel) {
+		out << indent(tabs) << "for (i" << level << " = 0; i" << level << " < n; ++i" << level << ")\n";
+	}
+	out << indent(tabs) << "{\n";
+	if (numPragmas > 1) {
+		out << indent(tabs + 1);
+		writeRegion(out, shape, level + 1, numPragmas - 1);
+	} else if (parallel) {
+		out << indent(tabs + 1) << "a[0] += 1.0;\n";
+	} else {
+		out << indent(tabs + 1) << "a[i" << level << "] += 1.0;\n";
+	}
+	out << indent(tabs) << "}\n";
+}
+
+void writeFunction(std::ostream& out, const CorpusShape& shape, unsigned fileIdx, unsigned funcIdx, unsigned numPragmas) {
+	const unsigned depth = shape.depth ? shape.depth : 1;
+	const unsigned numVars = shape.clauses * shape.varListLength;
+
+	out << "void f" << fileIdx << "_" << funcIdx << "(int n, double* a) {\n";
+	out << "\tint i0";
+	for (unsigned i = 1; i < depth; ++i) { out << ", i" << i; }
+	out << ";\n";
+	for (unsigned i = 0; i < numVars; ++i) {
+		out << (i % 8 ? ", " : "\tint ") << "v" << i << " = " << i;
+		if (i % 8 == 7 || i + 1 == numVars) { out << ";\n"; }
+	}
+
+	if (numPragmas == 0) {
+		out << "\tfor (i0 = 0; i0 < n; ++i0)\n\t\ta[i0] *= 2.0;\n";
+	}
+	while (numPragmas > 0) {
+		const unsigned curr = numPragmas < depth ? numPragmas : depth;
+		out << "\t";
+		writeRegion(out, shape, 0, curr);
+		numPragmas -= curr;
+	}
+	out << "}\n\n";
+}
+
+// directives cycled by the dense function, each one is attached to the statement following it
+const char* const densePragmas[] = { "critical", "atomic", "for", "master", "single nowait", "barrier" };
+
+void writeDensePragma(std::ostream& out, unsigned idx, unsigned tabs) {
+	const char* directive = densePragmas[idx % 6];
+	out << indent(tabs) << "#pragma omp " << directive << "\n";
+	if (directive == std::string("for")) {
+		out << indent(tabs) << "for (i = 0; i < n; ++i) a[i] += " << idx << ".0;\n";
+	} else if (directive != std::string("barrier")) {
+		out << indent(tabs) << "a[" << idx << "] += 1.0;\n";
+	}
+}
+
+// stand-alone directives closing the blocks of the dense function, they are not followed by
+// any statement of the block and are attached to a NullStmt appended to it
+const char* const trailingPragmas[] = { "barrier", "flush", "flush(a)" };
+
+void writeTrailingPragmas(std::ostream& out, unsigned trailing, unsigned tabs) {
+	for (unsigned t = 0; t < trailing; ++t) {
+		out << indent(tabs) << "#pragma omp " << trailingPragmas[t % 3] << "\n";
+	}
+}
+
+} // end anonymous namespace
+
+namespace clomp {
+namespace bench {
+
+bool CorpusShape::setKnob(const std::string& name, const std::string& value) {
+	unsigned* knob = NULL;
+	if (name == "--functions") 			{ knob = &functions; }
+	else if (name == "--pragmas") 		{ knob = &pragmas; }
+	else if (name == "--clauses") 		{ knob = &clauses; }
+	else if (name == "--depth") 		{ knob = &depth; }
+	else if (name == "--var-list") 		{ knob = &varListLength; }
+	else if (name == "--lang") 			{ cxx = value == "c++"; return value == "c" || value == "c++"; }
+	if (!knob) { return false; }
+	*knob = strtoul(value.c_str(), NULL, 10);
+	return true;
+}
+
+const char* CorpusShape::usage() {
+	return 
+		"  --functions <n>  functions per file (default 16)\n"
+		"  --pragmas <n>    OpenMP pragmas per file (default 64)\n"
+		"  --clauses <n>    clauses per pragma (default 3)\n"
+		"  --depth <n>      nesting depth of the pragmas (default 2)\n"
+		"  --var-list <n>   variables listed by each data-sharing clause (default 4)\n"
+		"  --lang <c|c++>   language of the generated files (default c)\n";
+}
+
+std::string generateSource(const CorpusShape& shape, unsigned index) {
+	std::ostringstream ss;
+	ss << "// synthetic input generated by clomp's corpus generator\n\n";
+
+	const unsigned functions = shape.functions ? shape.functions : 1;
+	for (unsigned f = 0; f < functions; ++f) {
+		const unsigned numPragmas = shape.pragmas / functions + (f < shape.pragmas % functions ? 1 : 0);
+		writeFunction(ss, shape, index, f, numPragmas);
+	}
+	return ss.str();
+}
+
+std::string generateDenseFunction(unsigned pragmas, unsigned blockLength, unsigned depth, unsigned trailing) {
+	std::ostringstream ss;
+	ss << "void dense(int n, double* a) {\n\tint i;\n";
+
+	depth = depth ? depth : 1;
+	unsigned idx = 0;
+	for (unsigned level = 0; level < depth; ++level) {
+		const unsigned tabs = level + 1;
+		if (level > 0) { ss << indent(level) << "if (n > " << level << ") {\n"; }
+
+		const unsigned numPragmas = pragmas / depth + (level < pragmas % depth ? 1 : 0);
+		for (unsigned p = 0; p < numPragmas; ++p, ++idx) {
+			writeDensePragma(ss, idx, tabs);
+			for (unsigned b = 0; b < blockLength; ++b) {
+				ss << indent(tabs) << "a[" << b << "] = a[" << b << "] * 2.0;\n";
+			}
+		}
+	}
+	for (unsigned level = depth - 1; level > 0; --level) { 
+		writeTrailingPragmas(ss, trailing, level + 1);
+		ss << indent(level) << "}\n"; 
+	}
+	writeTrailingPragmas(ss, trailing, 1);
+	ss << "}\n";
+	return ss.str();
+}
+
+std::vector<std::string> generateCorpus(const CorpusShape& shape, unsigned numFiles, const std::string& dir) {
+	std::vector<std::string> files;
+	for (unsigned i = 0; i < numFiles; ++i) {
+		std::ostringstream name;
+		name << dir << "/input" << i << (shape.cxx ? ".cpp" : ".c");
+
+		std::ofstream out(name.str().c_str());
+		if (!(out << generateSource(shape, i))) {
+			throw std::runtime_error("unable to write " + name.str());
+		}
+		files.push_back(name.str());
+	}
+	return files;
+}
+
+} // end bench namespace
+} // end clomp namespace
@@ -0,0 +1,66 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace clomp {
+namespace bench {
+
+// ------------------------------------ CorpusShape ---------------------------
+/**
+ * Knobs of the synthetic corpus. Every file defines the same number of functions
+ * and the pragmas of a file are spread evenly across its functions.
+ */
+struct CorpusShape {
+	/* Functions defined in each file */
+	unsigned functions;
+	/* OpenMP pragmas in each file */
+	unsigned pragmas;
+	/* Clauses of each pragma (the clauses are cycled when they exceed those available) */
+	unsigned clauses;
+	/* Pragmas nested into each other: parallel regions alternate with worksharing loops */
+	unsigned depth;
+	/* Variables listed by each data-sharing clause (e.g. private) */
+	unsigned varListLength;
+	/* Generates C++ (.cpp) instead of C (.c) files */
+	bool cxx;
+
+	CorpusShape(): functions(16), pragmas(64), clauses(3), depth(2), varListLength(4), cxx(false) { }
+
+	/**
+	 * Parses a knob given on the command line as --<name> <value>, returns false 
+	 * if name is not a knob of the shape
+	 */
+	bool setKnob(const std::string& name, const std::string& value);
+
+	static const char* usage();
+};
+
+/**
+ * Returns the source of a file of the corpus, files with a different index only 
+ * differ by the names of their functions
+ */
+std::string generateSource(const CorpusShape& shape, unsigned index);
+
+/**
+ * Writes numFiles files of the corpus into the directory dir and returns their paths
+ */
+std::vector<std::string> generateCorpus(const CorpusShape& shape, unsigned numFiles, const std::string& dir);
+
+/**
+ * Returns the source of a single function dense of statement pragmas, used to stress the
+ * association of the pragmas to the AST. The pragmas are spread evenly across depth nested
+ * blocks and each of them is followed by blockLength plain statements. Each block ends with 
+ * trailing barrier/flush pragmas, which are not followed by any statement of the block and 
+ * force the compound statement to be rebuilt.
+ */
+std::string generateDenseFunction(unsigned pragmas, unsigned blockLength, unsigned depth, unsigned trailing = 0);
+
+} // end bench namespace
+} // end clomp namespace
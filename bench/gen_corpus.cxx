@@ -0,0 +1,52 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#include "corpus.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+
+using namespace clomp::bench;
+
+void usage(const char* prog) {
+	std::cerr << "usage: " << prog << " [--files <n>] [<knobs>] <output dir>" << std::endl
+			  << std::endl
+			  << "  --files <n>      number of files to generate (default 1)" << std::endl
+			  << CorpusShape::usage();
+}
+
+int main(int argc, char* argv[]) {
+
+	CorpusShape shape;
+	unsigned numFiles = 1;
+	std::string dir;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg(argv[i]);
+		if (arg == "--files" && i+1 < argc) {
+			numFiles = atoi(argv[++i]);
+		} else if (!arg.empty() && arg[0] == '-') {
+			if (i+1 == argc || !shape.setKnob(arg, argv[++i])) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else {
+			dir = arg;
+		}
+	}
+
+	if (dir.empty()) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		generateCorpus(shape, numFiles, dir);
+	} catch (const std::runtime_error& e) {
+		std::cerr << "error: " << e.what() << std::endl;
+		return 1;
+	}
+}
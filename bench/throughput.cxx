@@ -0,0 +1,116 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#include "corpus.h"
+
+#include "driver/program.h"
+#include "utils/stats.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace clomp;
+using namespace clomp::bench;
+
+/*
+ * Measures the throughput of the whole Program pipeline (compiler setup, parsing,
+ * pragma matching and association) on a synthetic corpus or on the given files.
+ */
+
+void usage(const char* prog) {
+	std::cerr << "usage: " << prog << " [-j <threads>] [--files <n>] [<knobs>] [<file> ...]" << std::endl
+			  << std::endl
+			  << "  -j <threads>     number of threads parsing the files (default 1)" << std::endl
+			  << "  --files <n>      number of files of the generated corpus (default 8)" << std::endl
+			  << CorpusShape::usage()
+			  << std::endl
+			  << "When input files are given the corpus is not generated." << std::endl;
+}
+
+size_t fileSize(const std::string& path) {
+	struct stat st;
+	return ::stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+int main(int argc, char* argv[]) {
+
+	CorpusShape shape;
+	unsigned numFiles = 8, threads = 1;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg(argv[i]);
+		if (arg == "-j" && i+1 < argc) {
+			threads = std::max(atoi(argv[++i]), 1);
+		} else if (arg == "--files" && i+1 < argc) {
+			numFiles = atoi(argv[++i]);
+		} else if (!arg.empty() && arg[0] == '-') {
+			if (i+1 == argc || !shape.setKnob(arg, argv[++i])) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else {
+			files.push_back(arg);
+		}
+	}
+
+	std::string tmpDir;
+	if (files.empty()) {
+		char dirTemplate[] = "/tmp/clomp-bench-XXXXXX";
+		if (!mkdtemp(dirTemplate)) {
+			std::cerr << "error: unable to create a temporary directory" << std::endl;
+			return 1;
+		}
+		tmpDir = dirTemplate;
+		files = generateCorpus(shape, numFiles, tmpDir);
+	}
+
+	size_t bytes = 0;
+	std::for_each(files.begin(), files.end(), [&](const std::string& cur) { bytes += fileSize(cur); });
+
+	MemoryUsage::resetPeak();
+	const MemoryUsage before = MemoryUsage::current();
+	const auto start = std::chrono::steady_clock::now();
+
+	size_t numPragmas = 0;
+	int ret = 0;
+	{
+		Program prog;
+		try {
+			std::vector<TranslationUnitPtr>&& tus = prog.addTranslationUnits(files, CompilerOptions(), threads);
+			std::for_each(tus.begin(), tus.end(), [&](const TranslationUnitPtr& cur) {
+				numPragmas += cur->getPragmaList().size();
+			});
+		} catch (const std::exception& e) {
+			std::cerr << "error: unable to parse translation unit: " << e.what() << std::endl;
+			ret = 1;
+		}
+	}
+
+	const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const MemoryUsage after = MemoryUsage::current();
+
+	if (!tmpDir.empty()) {
+		std::for_each(files.begin(), files.end(), [](const std::string& cur) { ::unlink(cur.c_str()); });
+		::rmdir(tmpDir.c_str());
+	}
+	if (ret) { return ret; }
+
+	std::cout << std::fixed << std::setprecision(3)
+			  << "files:          " << files.size() << std::endl
+			  << "input:          " << bytes / (1024.0 * 1024.0) << " MB" << std::endl
+			  << "pragmas:        " << numPragmas << std::endl
+			  << "time:           " << secs << " s" << std::endl
+			  << "pragmas/second: " << numPragmas / secs << std::endl
+			  << "MB/second:      " << bytes / (1024.0 * 1024.0) / secs << std::endl
+			  << "peak memory:    " << after.peakRSS / (1024.0 * 1024.0) << " MB (+" 
+			  					  << (after.peakRSS - std::min(after.peakRSS, before.rss)) / (1024.0 * 1024.0) << " MB)" << std::endl;
+}
@@ -0,0 +1,96 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#pragma once
+
+#include "driver/compiler.h"
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <memory>
+
+namespace clomp { 
+
+class TranslationUnit;
+class ResultCache;
+
+/**
+ * Writes to the output stream the OpenMP pragmas found in the translation unit 
+ * using the same format of clomp-driver (the pragmas of a detached translation
+ * unit are printed as by printInventory). Returns the number of pragmas printed.
+ */
+unsigned printPragmas(std::ostream& out, const TranslationUnit& tu);
+
+/**
+ * Writes to the output stream the OpenMP pragmas collected in lexer mode (see 
+ * collectPragmas). Returns the number of pragmas printed.
+ */
+unsigned printInventory(std::ostream& out, const PragmaInfoList& inventory);
+
+/**
+ * A file to be processed by the batch driver together with the options used to
+ * compile it.
+ */
+struct BatchEntry {
+	std::string 	file;
+	CompilerOptions options;
+
+	BatchEntry(const std::string& file, const CompilerOptions& options = CompilerOptions()) :
+		file(file), options(options) { }
+};
+
+// ------------------------------------ BatchDriver ---------------------------
+/**
+ * Processes a list of input files either within the current process or using 
+ * a pool of worker processes. 
+ *
+ * When running in-process the per-process costs (e.g. the start up of the 
+ * process and the set up of the OpenMP grammar) are paid only once and the 
+ * output of all files is buffered and written in large chunks. A compiler is 
+ * still set up for every file (see ClangCompiler), clang does not allow its 
+ * preprocessor and builtins to be reused by a new translation unit.
+ *
+ * When using workers each worker is a forked child which parses one file at 
+ * the time and streams the result back to the parent through a pipe. The parent
+ * merges the results and writes them to the output stream following the order
+ * of the input list. A worker crashing (e.g. because of a failed assertion), 
+ * or sending a result for a file other than the one it was given, only affects 
+ * the file it was processing, a new worker is spawned for the remaining files.
+ *
+ * When a result cache is set, the files whose result is found in the cache are
+ * not parsed and the results of the files successfully parsed are stored.
+ */
+class BatchDriver {
+	std::vector<BatchEntry> mEntries;
+	unsigned mJobs;
+	bool mInventory;
+	std::shared_ptr<const ResultCache> mCache;
+
+	unsigned runInProcess(std::ostream& out);
+	unsigned runWorkers(std::ostream& out);
+
+public:
+	/**
+	 * Creates a batch for the given entries, if jobs is 0 the files are processed
+	 * by the current process, otherwise by a pool of jobs worker processes. In 
+	 * inventory mode the pragmas are collected without building the AST.
+	 */
+	BatchDriver(const std::vector<BatchEntry>& entries, unsigned jobs, bool inventory = false);
+
+	/**
+	 * Sets the cache used to store the results of the files
+	 */
+	void setCache(const std::shared_ptr<const ResultCache>& cache) { mCache = cache; }
+
+	/**
+	 * Runs the batch and returns the number of files which failed (either 
+	 * because of a parsing error or because the worker crashed).
+	 */
+	unsigned run(std::ostream& out);
+};
+
+} // end clomp namespace
@@ -0,0 +1,79 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#pragma once
+
+#include "driver/compiler.h"
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <stdint.h>
+
+namespace clomp {
+
+/**
+ * Returns the 64 bit FNV-1a hash of the buffer
+ */
+uint64_t hashBuffer(const char* begin, const char* end, uint64_t seed = 14695981039346656037ULL);
+
+/**
+ * Used to report that the cache directory cannot be used
+ */
+struct CacheError: public std::runtime_error {
+	CacheError(const std::string& msg): std::runtime_error(msg) { }
+};
+
+// ------------------------------------ ResultCache ---------------------------
+/**
+ * An on-disk cache of the results produced for the translation units.
+ *
+ * A result is stored under a key which identifies how the translation unit is
+ * processed (the main file, the compiler options and the kind of result),
+ * together with the content hash of every file the result depends on. A lookup
+ * succeeds only if none of the dependencies changed since the result was stored,
+ * therefore editing a header invalidates the results of the files including it.
+ *
+ * Each record is written to a temporary file which is then renamed, so several
+ * processes can share the same cache directory. Failures to read or write the
+ * records are never fatal: they just result in a cache miss.
+ */
+class ResultCache {
+	std::string mDir;
+
+	std::string recordPath(const std::string& key) const;
+
+public:
+	/**
+	 * Uses (and creates if needed) the given cache directory, a CacheError is
+	 * thrown if the directory cannot be created.
+	 */
+	ResultCache(const std::string& dir);
+
+	/**
+	 * Builds the key of a translation unit, the kind distinguishes the different
+	 * results which can be produced for the same file (e.g. the pragma report and
+	 * the pragma inventory).
+	 */
+	static std::string makeKey(const std::string& kind, const std::string& fileName, const CompilerOptions& options);
+
+	/**
+	 * Looks up the result stored for key, true is returned (and the result is copied
+	 * into output) only if the content of all its dependencies is unchanged. When 
+	 * dependencies is given, the dependencies of the result are copied into it.
+	 */
+	bool lookup(const std::string& key, std::string& output, std::vector<FileDependency>* dependencies = NULL) const;
+
+	/**
+	 * Stores the result for key. The hashes of the dependencies must be those of the
+	 * content the result was built from (e.g. the buffers parsed by the compiler), so
+	 * that a file changed while the result was being built invalidates it. Returns 
+	 * false if the record could not be written.
+	 */
+	bool store(const std::string& key, const std::vector<FileDependency>& dependencies, const std::string& output) const;
+};
+
+} // end clomp namespace
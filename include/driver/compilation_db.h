@@ -0,0 +1,64 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#pragma once
+
+#include "driver/compiler.h"
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+namespace clomp {
+
+/**
+ * Used to report an error occurred while reading a compilation database
+ */
+struct CompilationDatabaseError: public std::runtime_error {
+	CompilationDatabaseError(const std::string& msg): std::runtime_error(msg) { }
+};
+
+// ------------------------------------ CompileCommand ---------------------------
+/**
+ * An entry of a compilation database (compile_commands.json), i.e. the command
+ * used to compile a single file of a project.
+ */
+struct CompileCommand {
+	/* The working directory of the compilation */
+	std::string directory;
+	/* The main translation unit source, as written in the database */
+	std::string file;
+	/* The compiler command line, split into arguments (argv[0] is the compiler) */
+	std::vector<std::string> arguments;
+
+	/**
+	 * Returns the path of the source file (relative paths are resolved against
+	 * the working directory of the compilation)
+	 */
+	std::string getFilePath() const;
+
+	/**
+	 * Extracts from the command line the options relevant to clomp (include paths
+	 * and macro definitions), relative include paths are resolved against the
+	 * working directory of the compilation.
+	 */
+	CompilerOptions getCompilerOptions() const;
+};
+
+typedef std::vector<CompileCommand> CompileCommandList;
+
+/**
+ * Reads a JSON compilation database (as produced by CMake or Bear) from file.
+ * A CompilationDatabaseError is thrown if the file cannot be read or parsed.
+ */
+CompileCommandList loadCompilationDatabase(const std::string& fileName);
+
+/**
+ * Splits a command line into arguments using the quoting rules of the shell.
+ */
+std::vector<std::string> splitCommandLine(const std::string& cmd);
+
+} // end clomp namespace
@@ -12,6 +12,7 @@
 #include <exception>
 #include <stdexcept>
 #include <cassert>
+#include <stdint.h>
 
 // forward declarations
 namespace clang {
@@ -35,16 +36,36 @@ class Indexer;
 class TypeConversion_FileTest_Test;
 class StmtConversion_FileTest_Test;
 
+namespace clomp {
+class PragmaInfo;
+typedef std::vector<PragmaInfo> PragmaInfoList;
+class ResultCache;
+} // end clomp namespace
+
 // ------------------------------------ ParserProxy ---------------------------
 /**
  * This is a proxy class which enables the access to internal clang features, i.e. Parser.
- * The main scope of this class is to handle the parsing of pragma(s) of the input file
+ * The main scope of this class is to handle the parsing of pragma(s) of the input file.
+ *
+ * The current proxy is kept per thread, so that several translation units can be parsed
+ * concurrently as long as each one of them is handled by a single thread.
+ *
+ * The proxy can also work without a parser (lexer mode), in that case tokens are read 
+ * directly from the preprocessor, no AST node is built for the pragma clauses and the 
+ * matched pragmas are collected into an inventory.
  */
 class ParserProxy {
-	static ParserProxy* currParser;
+	static thread_local ParserProxy* currParser;
 	clang::Parser* mParser;
 
-	ParserProxy(clang::Parser* parser): mParser(parser) { }
+	// lexer mode
+	clang::Preprocessor* 	mPP;
+	clang::Token* 			mTok;
+	clomp::PragmaInfoList* 	mInventory;
+
+	ParserProxy(clang::Parser* parser): mParser(parser), mPP(NULL), mTok(NULL), mInventory(NULL) { }
+	ParserProxy(clang::Preprocessor& PP, clomp::PragmaInfoList& inventory);
+	~ParserProxy();
 public:
 
 	/**
@@ -53,9 +74,19 @@ public:
 	 */
 	static void init(clang::Parser* parser=NULL) {
 		assert(parser && "ParserProxy cannot be initialized with a NULL parser");
+		assert(!currParser && "Parser proxy already initialized by this thread");
 		currParser = new ParserProxy(parser);
 	}
 
+	/**
+	 * Initialize the proxy in lexer mode, pragmas matched while lexing the input 
+	 * are appended to the inventory list.
+	 */
+	static void init(clang::Preprocessor& PP, clomp::PragmaInfoList& inventory) {
+		assert(!currParser && "Parser proxy already initialized by this thread");
+		currParser = new ParserProxy(PP, inventory);
+	}
+
 	/**
 	 * the discard method is called when the Parser is no longer valid.
 	 */
@@ -86,7 +117,19 @@ public:
 	 * Returns the last consumed token without advancing in the input stream
 	 */
 	clang::Token& CurrentToken();
+	/**
+	 * Enables/disables the skipping of the next function body, a skipped body is 
+	 * lexed but no statement is built for it
+	 */
+	void SkipFunctionBodies(bool skip);
+	/**
+	 * Returns the parser, NULL in lexer mode
+	 */
 	clang::Parser* getParser() const { return mParser; }
+	/**
+	 * Returns the list collecting the pragmas in lexer mode, NULL otherwise
+	 */
+	clomp::PragmaInfoList* getInventory() const { return mInventory; }
 };
 
 namespace clomp {
@@ -98,6 +141,69 @@ struct ClangParsingError: public std::logic_error {
 };
 
 
+// ------------------------------------ VirtualFile ---------------------------
+/**
+ * A source file whose content is held in memory, the file name is used as if the
+ * file was on disk (e.g. quoted includes are resolved relative to its directory, 
+ * which therefore must exist).
+ */
+struct VirtualFile {
+	std::string name;
+	std::string content;
+
+	VirtualFile(const std::string& name, const std::string& content): name(name), content(content) { }
+};
+
+/**
+ * A file read while building a translation unit, together with the hash of the content 
+ * which was actually read (see hashBuffer)
+ */
+struct FileDependency {
+	std::string name;
+	uint64_t 	hash;
+
+	FileDependency(const std::string& name, uint64_t hash): name(name), hash(hash) { }
+};
+
+// ------------------------------------ CompilerOptions ---------------------------
+/**
+ * Options used to set up the compiler for a translation unit (i.e. the include paths 
+ * and the macro definitions usually passed on the command line to the compiler).
+ */
+struct CompilerOptions {
+	/* Include paths searched for both "..." and <...> includes (i.e. -I) */
+	std::vector<std::string> includePaths;
+	/* Include paths searched only for "..." includes (i.e. -iquote) */
+	std::vector<std::string> quoteIncludePaths;
+	/* System include paths (i.e. -isystem) */
+	std::vector<std::string> systemIncludePaths;
+	/* Macro definitions in the form NAME or NAME=VALUE (i.e. -D) */
+	std::vector<std::string> definitions;
+	/* Macros to undefine (i.e. -U) */
+	std::vector<std::string> undefinitions;
+	/* Files (e.g. generated headers) whose content is taken from memory instead of the disk */
+	std::vector<VirtualFile> virtualFiles;
+	/* Skips the parsing of translation units which contain no OpenMP pragmas (see prescan.h),
+	 * the AST of such translation units is not built */
+	bool prescan;
+	/* Skips the parsing of the function bodies which contain no pragmas, only the 
+	 * declaration of such functions is added to the AST */
+	bool skipFunctionBodies;
+	/* Detaches the translation unit once it is parsed, i.e. its compiler and AST are 
+	 * released and only the self-contained form of the pragmas is kept */
+	bool detach;
+	/* Collects the timings and the counters of the phases of the translation unit (see ParseStats) */
+	bool collectStats;
+	/* Measures the memory used by the translation unit (see MemoryStats) */
+	bool collectMemory;
+	/* When set, the pragmas of a detached translation unit are looked up in (and stored into) 
+	 * the cache, the parsing is skipped if none of the files it depends on changed */
+	std::shared_ptr<const ResultCache> cache;
+
+	CompilerOptions(): 
+		prescan(false), skipFunctionBodies(false), detach(false), collectStats(false), collectMemory(false) { }
+};
+
 // ------------------------------------ ClangCompiler ---------------------------
 /**
  * ClangCompiler is a wrapper class for the Clang compiler main interfaces. The main goal is to hide implementation
@@ -111,11 +217,20 @@ class ClangCompiler {
 	/* Make this class noncopyable */
 	ClangCompiler(const ClangCompiler& other);
 
+	void init(const std::string& file_name, const CompilerOptions& options, const VirtualFile* input);
+
 public:
 	/**
-	 * Creates a compiler instance from an input file
+	 * Creates a compiler instance from an input file, a ClangParsingError is thrown
+	 * if the file cannot be found
+	 */
+	ClangCompiler(const std::string& file_name, const CompilerOptions& options = CompilerOptions());
+
+	/**
+	 * Creates a compiler instance from a memory buffer, no file is read from disk
+	 * for the input
 	 */
-	ClangCompiler(const std::string& file_name);
+	ClangCompiler(const VirtualFile& input, const CompilerOptions& options = CompilerOptions());
 
 	/**
 	 * Returns clang's ASTContext
@@ -147,6 +262,12 @@ public:
 	 */
 	clang::TargetInfo& getTargetInfo() const;
 
+	/**
+	 * Returns the files loaded so far by the compiler (sorted by name), i.e. the main file
+	 * and the headers it included. The files are hashed from the buffers which were parsed.
+	 */
+	std::vector<FileDependency> getDependencies() const;
+
 	~ClangCompiler();
 };
 
@@ -0,0 +1,150 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#pragma once
+
+#include <string>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+#include <stdint.h>
+
+namespace clomp {
+
+class Program;
+
+/**
+ * Layout of the binary pragma index. The file starts with a Header followed by
+ * four tables of fixed size records and by the characters of the strings:
+ *
+ * 		Header | StringEntry[] | PragmaEntry[] | ClauseEntry[] | ValueEntry[] | chars
+ *
+ * Strings (pragma types, file names, clause keys, variable names and expression
+ * spellings) are interned, records refer to them by their index in the string
+ * table. Integers are stored in the byte order of the host which wrote the index.
+ */
+namespace index {
+
+const uint32_t Version 		= 1;
+const uint32_t ByteOrderMark = 0x01020304;
+
+struct Header {
+	char 	 magic[8];		// "CLOMPIDX"
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t numStrings;
+	uint32_t numPragmas;
+	uint32_t numClauses;
+	uint32_t numValues;
+	uint64_t stringsOffset;
+	uint64_t pragmasOffset;
+	uint64_t clausesOffset;
+	uint64_t valuesOffset;
+	uint64_t charsOffset;
+	uint64_t charsSize;
+};
+
+struct StringEntry {
+	uint32_t offset;		// relative to the beginning of the characters
+	uint32_t length;
+};
+
+enum TargetKind { TARGET_NONE = 0, TARGET_STMT = 1, TARGET_DECL = 2 };
+
+struct PragmaEntry {
+	uint32_t type;
+	uint32_t file;
+	uint32_t line, column;
+	// file offsets of the pragma and of the node it is attached to
+	uint32_t startOffset, endOffset;
+	uint32_t targetKind;
+	uint32_t targetStart, targetEnd;
+	// clauses of the pragma: ClauseEntry[firstClause, firstClause + numClauses)
+	uint32_t firstClause, numClauses;
+};
+
+struct ClauseEntry {
+	uint32_t key;
+	// values of the clause: ValueEntry[firstValue, firstValue + numValues)
+	uint32_t firstValue, numValues;
+};
+
+enum ValueKind { VALUE_STRING = 0, VALUE_VARIABLE = 1, VALUE_EXPRESSION = 2 };
+
+struct ValueEntry {
+	uint32_t kind;
+	uint32_t str;
+};
+
+} // end index namespace
+
+/**
+ * Used to report an index which cannot be written or read
+ */
+struct IndexError: public std::runtime_error {
+	IndexError(const std::string& msg): std::runtime_error(msg) { }
+};
+
+/**
+ * Writes the pragmas of all the translation units of the program to the output
+ * stream using the binary index format. Returns the number of pragmas written.
+ */
+unsigned writePragmaIndex(std::ostream& out, const Program& prog);
+
+// ------------------------------------ PragmaIndex ---------------------------
+/**
+ * Read only view of a binary pragma index. The file is memory mapped and the
+ * records are accessed in place, neither the loading (besides the validation of
+ * the tables) nor the iteration allocate memory.
+ */
+class PragmaIndex {
+	const char* 			mData;
+	size_t 					mSize;
+	const index::Header* 	mHeader;
+
+	// Make this class noncopyable
+	PragmaIndex(const PragmaIndex&);
+
+	void validate() const;
+
+public:
+	/**
+	 * A string of the index, the characters are not null terminated
+	 */
+	struct String {
+		const char* data;
+		size_t 		size;
+
+		std::string str() const { return std::string(data, size); }
+		bool operator==(const char* other) const;
+	};
+
+	typedef const index::PragmaEntry* 	pragma_iterator;
+	typedef const index::ClauseEntry* 	clause_iterator;
+	typedef const index::ValueEntry* 	value_iterator;
+
+	/**
+	 * Maps the index file, an IndexError is thrown if the file cannot be read or
+	 * if it is not a valid index (e.g. it was written with a different version).
+	 */
+	PragmaIndex(const std::string& fileName);
+	~PragmaIndex();
+
+	size_t size() const { return mHeader->numPragmas; }
+
+	pragma_iterator begin() const;
+	pragma_iterator end() const { return begin() + size(); }
+
+	std::pair<clause_iterator, clause_iterator> clauses(const index::PragmaEntry& pragma) const;
+	std::pair<value_iterator, value_iterator> values(const index::ClauseEntry& clause) const;
+
+	/**
+	 * Returns the string with the given index in the string table
+	 */
+	String getString(uint32_t idx) const;
+};
+
+} // end clomp namespace
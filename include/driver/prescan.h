@@ -0,0 +1,74 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#pragma once
+
+#include "driver/compiler.h"
+
+#include <string>
+#include <vector>
+
+namespace clomp {
+
+// ------------------------------------ Prescan ---------------------------
+/**
+ * An #include (or #include_next, #import) directive found by the pre-scan
+ */
+struct PrescanInclude {
+	std::string name;
+	bool 		angled;
+
+	PrescanInclude(const std::string& name, bool angled): name(name), angled(angled) { }
+};
+
+/**
+ * Scans the raw bytes of a source file looking for OpenMP pragmas, i.e. '#pragma omp'
+ * directives or '_Pragma("omp ...")' operators. The scan is conservative: true is
+ * returned whenever the buffer may contain an OpenMP pragma (e.g. an _Pragma whose
+ * argument is built by a macro, or an #include whose file name is a macro).
+ *
+ * The include directives encountered are appended to the includes list.
+ */
+bool prescanBuffer(const char* begin, const char* end, std::vector<PrescanInclude>& includes);
+
+/**
+ * Checks whether the argument of an _Pragma operator, starting at begin, may be an OpenMP
+ * pragma: true is returned if it is a string literal starting with omp or if it is not a 
+ * string literal at all (e.g. it is built by a macro).
+ */
+bool mayBeOmpPragmaLiteral(const char* begin, const char* end);
+
+/**
+ * Collects the (sorted) offsets of the points of the buffer where a pragma can enter the 
+ * token stream: pragma directives, _Pragma operators and include directives.
+ */
+void findPragmaPoints(const char* begin, const char* end, std::vector<unsigned>& offsets);
+
+/**
+ * Returns false if neither the input file nor any of the files it (transitively)
+ * includes contains an OpenMP pragma, in that case parsing the translation unit
+ * would produce an empty pragma list.
+ *
+ * Includes are resolved using the directory of the including file and the quote, user
+ * and system include paths of the options. A quoted include which cannot be resolved 
+ * makes the result true, while angled ones are assumed to belong to the default system 
+ * directories of the compiler (e.g. the C library) and are not scanned. The virtual 
+ * files of the options are scanned in place of the files on disk with the same name.
+ *
+ * When false is returned and scannedFiles is given, the files which have been
+ * scanned (i.e. the ones the result depends on) are appended to it, each one with
+ * the hash of the content which was scanned.
+ */
+bool mayContainOmpPragmas(const std::string& fileName, const CompilerOptions& options, 
+						  std::vector<FileDependency>* scannedFiles = NULL);
+
+/**
+ * Like mayContainOmpPragmas but the input is read from a memory buffer
+ */
+bool mayContainOmpPragmas(const VirtualFile& input, const CompilerOptions& options, 
+						  std::vector<FileDependency>* scannedFiles = NULL);
+
+} // end clomp namespace
@@ -7,9 +7,11 @@
 #pragma once
 
 #include "compiler.h"
+#include "utils/stats.h"
 
 #include <set>
 #include <memory>
+#include <vector>
 #include <algorithm>
 
 namespace clang {
@@ -22,6 +24,7 @@ class TranslationUnit;
 namespace clomp { 
 
 class Pragma;
+class PragmaConsumer;
 typedef std::shared_ptr<Pragma> PragmaPtr;
 typedef std::vector<PragmaPtr> PragmaList;
 
@@ -37,25 +40,119 @@ class TranslationUnit {
 	TranslationUnit(const TranslationUnit&);
 
 protected:
-	std::string 			mFileName;
-	ClangCompiler			mClang;
-	PragmaList 				mPragmaList;
+	std::string 					mFileName;
+	std::unique_ptr<ClangCompiler>	mClang;
+	PragmaList 						mPragmaList;
+	// pragmas of a detached translation unit
+	PragmaInfoList 					mPragmaInfos;
+	std::vector<FileDependency> 	mDependencies;
+	// the pragmas have been taken from the result cache
+	bool 							mCached;
+	ParseStats 						mStats;
+	MemoryStats 					mMemory;
+
+	void init(const VirtualFile* input, const CompilerOptions& options, PragmaConsumer* consumer);
+	bool loadFromCache(const ResultCache& cache, const std::string& key);
+	void storeToCache(const ResultCache& cache, const std::string& key, const CompilerOptions& options) const;
+	void measureMemory();
+	void parse(const CompilerOptions& options, PragmaConsumer* consumer = NULL);
 
 public:
-	TranslationUnit(const std::string& fileName);
+	TranslationUnit(const std::string& fileName, const CompilerOptions& options = CompilerOptions());
 
 	/**
-	 * Returns a list of pragmas defined in the translation unit
+	 * Builds the translation unit from a memory buffer, the name of the input is used 
+	 * as file name (see VirtualFile)
+	 */
+	TranslationUnit(const VirtualFile& input, const CompilerOptions& options = CompilerOptions());
+
+	/**
+	 * Builds the translation unit streaming its pragmas to the consumer while the file is 
+	 * parsed (see PragmaConsumer), the pragmas are not kept in the pragma list
+	 */
+	TranslationUnit(const std::string& fileName, PragmaConsumer& consumer, const CompilerOptions& options = CompilerOptions());
+
+	~TranslationUnit();
+
+	/**
+	 * Returns a list of pragmas defined in the translation unit, the list is empty
+	 * once the translation unit is detached
 	 */
 	const PragmaList& getPragmaList() const { return mPragmaList; }
 	
-	const ClangCompiler& getCompiler() const {  return mClang; }
+	/**
+	 * Returns the compiler which parsed the translation unit, it must not be called
+	 * on a detached translation unit. A translation unit skipped by the pre-scan 
+	 * (see CompilerOptions::prescan) has never had a compiler and is detached from 
+	 * the start.
+	 */
+	const ClangCompiler& getCompiler() const {  
+		assert(mClang && "The compiler of a detached translation unit has been released");
+		return *mClang; 
+	}
 	
 	const std::string& getFileName() const { 	return mFileName; }
+
+	/**
+	 * Returns the files the pragma list depends on: the main file and the headers read
+	 * while parsing it (or while pre-scanning it when the parsing has been skipped)
+	 */
+	const std::vector<FileDependency>& getDependencies() const { return mDependencies; }
+
+	/**
+	 * Returns the timings and counters collected while the translation unit was built,
+	 * all zero unless CompilerOptions::collectStats is set
+	 */
+	const ParseStats& getStats() const { return mStats; }
+
+	/**
+	 * Returns the memory used by the translation unit, all zero unless 
+	 * CompilerOptions::collectMemory is set. The peak is the process-wide one 
+	 * (see MemoryStats).
+	 */
+	const MemoryStats& getMemoryStats() const { return mMemory; }
+
+	/**
+	 * Returns the self-contained description of one of the pragmas of the list
+	 */
+	PragmaInfo describe(const Pragma& pragma) const;
+
+	/**
+	 * Converts the pragmas into their self-contained form (see PragmaInfo) and releases
+	 * the compiler together with the AST. Afterwards the pragmas are only available 
+	 * through getPragmaInfos.
+	 */
+	void detach();
+
+	bool isDetached() const { return !mClang; }
+
+	/**
+	 * Returns true if the pragmas have been taken from the cache of the options (see 
+	 * CompilerOptions::cache), in that case the file has not been parsed
+	 */
+	bool isCached() const { return mCached; }
+
+	/**
+	 * Returns the pragmas of a detached translation unit
+	 */
+	const PragmaInfoList& getPragmaInfos() const { return mPragmaInfos; }
 };
 
 typedef std::shared_ptr<TranslationUnit> TranslationUnitPtr;
 
+/**
+ * Collects the pragmas of a file in lexer mode: the input is only preprocessed, the
+ * pragma matchers are run but no AST is built, therefore clause expressions are kept
+ * as the spelling of their tokens and pragmas are not associated to any node.
+ *
+ * A ClangParsingError is thrown if the preprocessor reports an error. When dependencies 
+ * is given, the files read to build the inventory are appended to it. Statistics are 
+ * collected into the current ParseStats (see StatsScope).
+ */
+PragmaInfoList collectPragmas(const std::string& fileName, const CompilerOptions& options = CompilerOptions(),
+							  std::vector<FileDependency>* dependencies = NULL);
+PragmaInfoList collectPragmas(const VirtualFile& input, const CompilerOptions& options = CompilerOptions());
+
 // ------------------------------------ Program ---------------------------
 /**
  * A program is made of a set of compilation units, we need to keep this object
@@ -83,7 +180,27 @@ public:
 	/**
 	 * Add a single file to the program
 	 */
-	TranslationUnit& addTranslationUnit(const std::string& fileName);
+	TranslationUnit& addTranslationUnit(const std::string& fileName, 
+										const CompilerOptions& options = CompilerOptions());
+
+	/**
+	 * Add a single file, held in memory, to the program
+	 */
+	TranslationUnit& addTranslationUnit(const VirtualFile& input, 
+										const CompilerOptions& options = CompilerOptions());
+
+	/**
+	 * Add a list of files to the program, all compiled with the given options. The 
+	 * translation units are parsed concurrently by a pool of threads (when threads is 0
+	 * the number of available cores is used).
+	 *
+	 * The translation units are returned in the same order of the input files. If the
+	 * parsing of any of the files fails, the remaining files are still added to the
+	 * program and the first error encountered is rethrown once all workers are done.
+	 */
+	std::vector<TranslationUnitPtr> addTranslationUnits(const std::vector<std::string>& fileNames,
+														const CompilerOptions& options = CompilerOptions(),
+														unsigned threads = 0);
 
 	/**
 	 * Returns a list of parsed translation units
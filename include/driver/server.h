@@ -0,0 +1,98 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#pragma once
+
+#include "driver/compiler.h"
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <string>
+#include <stdexcept>
+
+namespace clomp {
+
+/**
+ * Used to report an error occurred while setting up the server socket
+ */
+struct ServerError: public std::runtime_error {
+	ServerError(const std::string& msg): std::runtime_error(msg) { }
+};
+
+// ------------------------------------ Server ---------------------------
+/**
+ * A long running clomp instance listening on a local (Unix domain) socket.
+ * The state which does not depend on the input file (e.g. the OpenMP grammar) 
+ * is set up once, each request only pays for the parsing of the file.
+ *
+ * Requests and responses are exchanged over the socket, each client can send 
+ * several requests over the same connection and clients are served concurrently:
+ *
+ * 		PARSE <path>\n 		parses the file and returns the list of pragmas
+ * 		INVENTORY <path>\n 	lists the pragmas of the file without building the AST
+ * 		PING\n 				checks whether the server is alive
+ * 		QUIT\n 				stops the server
+ *
+ * The content of a file can also be sent along with the request (e.g. the unsaved buffer
+ * of an editor), the <length> bytes following the request line are parsed in place of
+ * the file on disk (see VirtualFile):
+ *
+ * 		PARSE_BUFFER <length> <path>\n<length bytes of content>
+ * 		INVENTORY_BUFFER <length> <path>\n<length bytes of content>
+ *
+ * Every response has the form:
+ *
+ * 		(OK|ERR) <length>\n<length bytes of payload>
+ *
+ * where the payload of a successful PARSE is the report printed by clomp-driver.
+ */
+class Server {
+public:
+	typedef std::map<std::string, CompilerOptions> OptionsMap;
+
+private:
+	std::string mSocketPath;
+	OptionsMap 	mOptions;
+	// options used for the files not listed in mOptions
+	CompilerOptions mDefaultOptions;
+	int 		mListenFd;
+	std::atomic<bool> mQuit;
+
+	// connections currently being served
+	std::set<int> 			mClients;
+	std::mutex 				mClientsMutex;
+	std::condition_variable mClientsDone;
+
+	// Make this class noncopyable
+	Server(const Server&);
+
+	void serveClient(int fd);
+	// serves a PARSE or INVENTORY request, the file is read from input when given
+	bool handleParse(int fd, bool inventory, const std::string& file, const VirtualFile* input);
+
+public:
+	/**
+	 * Creates the socket, options contains the compiler options to use for specific
+	 * files (e.g. extracted from a compilation database), any other file is parsed
+	 * using defaultOptions. A ServerError is thrown if the socket cannot be created, 
+	 * if socketPath is a file other than a socket or if another server is listening
+	 * on it. A socket left behind by a server which is no longer running is replaced.
+	 */
+	Server(const std::string& 		socketPath, 
+		   const OptionsMap& 		options = OptionsMap(), 
+		   const CompilerOptions& 	defaultOptions = CompilerOptions());
+	~Server();
+
+	/**
+	 * Serves requests until a QUIT request is received
+	 */
+	void run();
+};
+
+} // end clomp namespace
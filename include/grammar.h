@@ -0,0 +1,432 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#pragma once
+
+#include "matcher.h"
+#include "utils/stats.h"
+
+#include <memory>
+#include <string>
+
+#include <clang/Lex/Preprocessor.h>
+
+namespace clomp {
+
+/**
+ * Statically typed version of the pragma matcher. The same operators of the runtime
+ * matcher (>>, |, *, !, [] and ~) are available, but they build template types instead
+ * of a tree of heap allocated nodes: the whole grammar of a pragma is a single value
+ * whose match method is resolved (and inlined) by the compiler, no virtual call is
+ * involved. The grammar is wrapped into a node (see rule) to be used by the pragma
+ * handlers.
+ *
+ * The semantics are those of the runtime matcher. When no error is recorded (see
+ * ParserStack) the alternatives, optional and repeated nodes which cannot start with the
+ * next token are skipped without being tried: as for the runtime matcher, the alternatives 
+ * of a choice are selected by a DispatchTable built once from their FIRST sets.
+ */
+namespace grammar {
+
+template <class L, class R> struct concat;
+template <class L, class R> struct choice;
+template <class N> struct star;
+template <class N> struct option;
+
+/**
+ * Base class of the nodes of a static grammar. Every node N provides:
+ *
+ *		bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const;
+ *		bool mayStartWith(const clang::Token& token) const;
+ *		FirstSet getFirst() const;
+ *		N operator[](const std::string& map_name) const;
+ *
+ * mayStartWith returns false only if the node cannot match starting with token.
+ */
+template <class Derived>
+struct grammar_node {
+	const Derived& self() const { return static_cast<const Derived&>(*this); }
+};
+
+template <class L, class R>
+concat<L, R> operator>>(const grammar_node<L>& n1, const grammar_node<R>& n2) {
+	return concat<L, R>(n1.self(), n2.self());
+}
+
+template <class L, class R>
+choice<L, R> operator|(const grammar_node<L>& n1, const grammar_node<R>& n2) {
+	return choice<L, R>(n1.self(), n2.self());
+}
+
+template <class N>
+star<N> operator*(const grammar_node<N>& n) { return star<N>(n.self()); }
+
+template <class N>
+option<N> operator!(const grammar_node<N>& n) { return option<N>(n.self()); }
+
+// ------------------------------------ leaves ---------------------------
+/**
+ * Matches a token of kind T
+ */
+template <clang::tok::TokenKind T>
+struct Tok: public grammar_node<Tok<T>> {
+	MatchKey 	key;
+	bool 		addToMap;
+	// identifiers are resolved to the variable they refer to (see var)
+	bool 		resolve;
+
+	Tok(): key(MatchKeyRegistry::NoKey), addToMap(true), resolve(false) { }
+	explicit Tok(bool resolve): key(MatchKeyRegistry::NoKey), addToMap(true), resolve(resolve) { }
+
+	Tok operator[](const std::string& map_name) const {
+		Tok ret(*this);
+		ret.key = MatchKeyRegistry::keyOf(map_name);
+		return ret;
+	}
+
+	/**
+	 * The token is never stored in the matcher map
+	 */
+	Tok operator~() const {
+		Tok ret(*this);
+		ret.addToMap = false;
+		return ret;
+	}
+
+	bool mayStartWith(const clang::Token& token) const { return token.is(T); }
+
+	FirstSet getFirst() const {
+		FirstSet first;
+		if (T == clang::tok::identifier) { first.anyIdentifier = true; }
+		else { first.tokens.insert(T); }
+		return first;
+	}
+
+	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+		return matchToken(PP, mmap, errStack, recID, T, resolve, key, addToMap);
+	}
+};
+
+/**
+ * Matches an identifier with the given spelling
+ */
+struct kwd: public grammar_node<kwd> {
+	std::string kw;
+	// key used when the keyword has no map name
+	MatchKey 	kwKey;
+	MatchKey 	key;
+	bool 		addToMap;
+
+	explicit kwd(const std::string& kw):
+		kw(kw), kwKey(MatchKeyRegistry::get(kw)), key(MatchKeyRegistry::NoKey), addToMap(true) { }
+
+	kwd operator[](const std::string& map_name) const {
+		kwd ret(*this);
+		ret.key = MatchKeyRegistry::keyOf(map_name);
+		return ret;
+	}
+
+	kwd operator~() const {
+		kwd ret(*this);
+		ret.addToMap = false;
+		return ret;
+	}
+
+	bool mayStartWith(const clang::Token& token) const {
+		return token.is(clang::tok::identifier) && token.getIdentifierInfo() &&
+			   token.getIdentifierInfo()->getName() == kw;
+	}
+
+	FirstSet getFirst() const {
+		FirstSet first;
+		first.keywords.insert(kw);
+		return first;
+	}
+
+	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+		return matchKeyword(PP, mmap, errStack, recID, kw, kwKey, key, addToMap);
+	}
+};
+
+/**
+ * Matches an expression (see clomp::expr_p)
+ */
+struct expr_p: public grammar_node<expr_p> {
+	MatchKey key;
+
+	expr_p(): key(MatchKeyRegistry::NoKey) { }
+
+	expr_p operator[](const std::string& map_name) const {
+		expr_p ret(*this);
+		ret.key = MatchKeyRegistry::keyOf(map_name);
+		return ret;
+	}
+
+	// the tokens starting an expression are not known
+	bool mayStartWith(const clang::Token& token) const { return true; }
+
+	FirstSet getFirst() const {
+		FirstSet first;
+		first.anyToken = true;
+		return first;
+	}
+
+	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+		return matchExpression(PP, mmap, errStack, recID, key);
+	}
+};
+
+// ------------------------------------ operators ---------------------------
+/**
+ * Implements the followed-by ('>>') semantics
+ */
+template <class L, class R>
+struct concat: public grammar_node<concat<L, R>> {
+	L first;
+	R second;
+
+	concat(const L& first, const R& second): first(first), second(second) { }
+
+	concat operator[](const std::string& map_name) const { return concat(first[map_name], second[map_name]); }
+
+	bool mayStartWith(const clang::Token& token) const { return first.mayStartWith(token); }
+
+	FirstSet getFirst() const {
+		FirstSet ret = first.getFirst();
+		if (ret.nullable) {
+			// the second node can start the match, the concatenation is nullable only if both are
+			FirstSet&& next = second.getFirst();
+			ret.merge(next);
+			ret.nullable = next.nullable;
+		}
+		return ret;
+	}
+
+	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+		return matchConcat(PP, mmap, errStack, first, second);
+	}
+};
+
+/**
+ * Walk of the alternatives of a chain of choices: index is the position of the next
+ * alternative, [cand, end) the candidates (see DispatchTable) which are still to be tried
+ */
+struct DispatchCursor {
+	unsigned index;
+	std::vector<unsigned>::const_iterator cand, end;
+	// all the alternatives are tried, e.g. to record the tokens they expect
+	bool all;
+};
+
+/**
+ * Collects the FIRST sets of the alternatives of a chain of choices, in the order they are tried
+ */
+template <class N>
+void collectFirsts(const N& alt, std::vector<FirstSet>& firsts) { firsts.push_back(alt.getFirst()); }
+
+template <class L, class R>
+void collectFirsts(const choice<L, R>& alt, std::vector<FirstSet>& firsts) {
+	collectFirsts(alt.first, firsts);
+	collectFirsts(alt.second, firsts);
+}
+
+/**
+ * Tries one alternative of a choice if it is a candidate, the tokens are restored if it fails
+ */
+template <class N>
+bool matchAlternative(const N& alt, clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack,
+					  size_t recID, DispatchCursor& cur)
+{
+	const unsigned index = cur.index++;
+	if (!cur.all) {
+		if (cur.cand == cur.end || *cur.cand != index) { return false; }
+		++cur.cand;
+	}
+
+	PP.EnableBacktrackAtThisPos();
+	if (alt.match(PP, mmap, errStack, recID)) {
+		PP.CommitBacktrackedTokens();
+		return true;
+	}
+	PP.Backtrack();
+	countStat(&ParseStats::backtracks);
+	return false;
+}
+
+/**
+ * The alternatives of a nested choice (n1 | n2 | ... | nk) share the same record and the
+ * dispatch table of the outermost choice
+ */
+template <class L, class R>
+bool matchAlternative(const choice<L, R>& alt, clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack,
+					  size_t recID, DispatchCursor& cur)
+{
+	return alt.matchAlternatives(PP, mmap, errStack, recID, cur);
+}
+
+/**
+ * Implements the choice ('|') semantics, the alternatives are tried in order
+ */
+template <class L, class R>
+struct choice: public grammar_node<choice<L, R>> {
+	L first;
+	R second;
+	// built once for the chain, the copies made by the operators share it
+	std::shared_ptr<const DispatchTable> table;
+
+	choice(const L& first, const R& second): first(first), second(second) { 
+		std::vector<FirstSet> firsts;
+		collectFirsts(*this, firsts);
+		table.reset( new DispatchTable(firsts) );
+	}
+
+	choice(const L& first, const R& second, const std::shared_ptr<const DispatchTable>& table): 
+		first(first), second(second), table(table) { }
+
+	// the map names do not change the FIRST sets
+	choice operator[](const std::string& map_name) const { return choice(first[map_name], second[map_name], table); }
+
+	bool mayStartWith(const clang::Token& token) const { return !table->getCandidates(token).empty(); }
+
+	FirstSet getFirst() const {
+		FirstSet ret = first.getFirst();
+		ret.merge(second.getFirst());
+		return ret;
+	}
+
+	bool matchAlternatives(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack,
+						   size_t recID, DispatchCursor& cur) const
+	{
+		return matchAlternative(first, PP, mmap, errStack, recID, cur) ||
+			   matchAlternative(second, PP, mmap, errStack, recID, cur);
+	}
+
+	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+		const std::vector<unsigned>& candidates = table->getCandidates(PP.LookAhead(0));
+		if (candidates.empty() && !errStack.isRecording()) { return false; }
+
+		DispatchCursor cur = { 0, candidates.begin(), candidates.end(), errStack.isRecording() };
+		size_t id = errStack.openRecord();
+		if (matchAlternatives(PP, mmap, errStack, id, cur)) {
+			errStack.discardRecord(id);
+			return true;
+		}
+		return false;
+	}
+};
+
+/**
+ * Implements the optional ('!') semantics
+ */
+template <class N>
+struct option: public grammar_node<option<N>> {
+	N node;
+
+	explicit option(const N& node): node(node) { }
+
+	option operator[](const std::string& map_name) const { return option(node[map_name]); }
+
+	bool mayStartWith(const clang::Token& token) const { return true; }
+
+	FirstSet getFirst() const {
+		FirstSet ret = node.getFirst();
+		ret.nullable = true;
+		return ret;
+	}
+
+	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+		if (!errStack.isRecording() && !node.mayStartWith(PP.LookAhead(0))) { return true; }
+
+		PP.EnableBacktrackAtThisPos();
+		if (node.match(PP, mmap, errStack, recID)) {
+			PP.CommitBacktrackedTokens();
+			return true;
+		}
+		PP.Backtrack();
+		countStat(&ParseStats::backtracks);
+		return true;
+	}
+};
+
+/**
+ * Implements the repetition ('*') semantics
+ */
+template <class N>
+struct star: public grammar_node<star<N>> {
+	N node;
+
+	explicit star(const N& node): node(node) { }
+
+	star operator[](const std::string& map_name) const { return star(node[map_name]); }
+
+	bool mayStartWith(const clang::Token& token) const { return true; }
+
+	FirstSet getFirst() const {
+		FirstSet ret = node.getFirst();
+		ret.nullable = true;
+		return ret;
+	}
+
+	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+		while ((errStack.isRecording() || node.mayStartWith(PP.LookAhead(0))) &&
+			   node.match(PP, mmap, errStack, recID))
+			;
+		return true;
+	}
+};
+
+// ------------------------------------ rule ---------------------------
+/**
+ * Wraps a static grammar into a node of the runtime matcher, the grammar is matched with
+ * a single virtual call
+ */
+template <class G>
+class rule: public clomp::node {
+	G mGrammar;
+
+public:
+	explicit rule(const G& grammar): mGrammar(grammar) { }
+
+	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+		return mGrammar.match(PP, mmap, errStack, recID);
+	}
+
+	node* copy() const { return new rule<G>(mGrammar); }
+
+	// the rule takes part in the dispatch of a runtime choice
+	FirstSet getFirst() const { return mGrammar.getFirst(); }
+
+	node& operator[](const std::string& map_name) {
+		mGrammar = mGrammar[map_name];
+		return *this;
+	}
+
+	const G& getGrammar() const { return mGrammar; }
+};
+
+/**
+ * Returns the node matching the grammar, to be given to PragmaHandlerFactory
+ */
+template <class G>
+std::shared_ptr<clomp::node> makeRule(const grammar_node<G>& grammar) {
+	return std::make_shared<rule<G>>(grammar.self());
+}
+
+// import token definitions from clang
+namespace tok {
+#define PUNCTUATOR(name, _) \
+	static const Tok<clang::tok::name>  name = Tok<clang::tok::name>();
+#define TOK(name) \
+	static const Tok<clang::tok::name>  name = Tok<clang::tok::name>();
+#include <clang/Basic/TokenKinds.def>
+#undef PUNCTUATOR
+#undef TOK
+static const expr_p 					expr = expr_p();
+static const Tok<clang::tok::identifier>  var  = Tok<clang::tok::identifier>(true);
+
+} // End tok namespace
+} // End grammar namespace
+} // End clomp namespace
@@ -12,6 +12,7 @@
 
 #include "matcher.h"
 #include "sema.h"
+#include "utils/stats.h"
 
 #include <clang/Basic/SourceLocation.h>
 #include <clang/Lex/Pragma.h>
@@ -44,9 +45,21 @@ class Pragma {
 	 */
 	void setDecl(clang::Decl const* decl);
 
+	/**
+	 * Computes the positions of the start and of the end of the pragma, done once when 
+	 * the pragma is registered with the parser
+	 */
+	void setPositions(const clang::SourceManager& sm);
+
 	friend class clomp::ClompSema;
 public:
 
+	/**
+	 * Position of a location within the translation unit: the file in which the location 
+	 * is expanded and the offset within that file
+	 */
+	typedef std::pair<clang::FileID, unsigned> Position;
+
 	/**
 	 * Type representing the target node which could be wither a statement
 	 * or a declaration
@@ -65,16 +78,25 @@ public:
 	/**
 	 * Creates a pragma starting from source location startLoc and ending ad endLoc
 	 * by passing the content of the map which associates, for each key defined in
-	 * the pragma_matcher, the relative parsed list of values.
+	 * the pragma_matcher, the relative parsed list of values. The map is moved into 
+	 * the pragma, a plain Pragma discards it.
 	 *
 	 */
 	Pragma(const clang::SourceLocation& startLoc, 
 		   const clang::SourceLocation& endLoc, 
 		   const std::string& 			type, 
-		   const MatchMap& 				mmap) : mStartLoc(startLoc), mEndLoc(endLoc), mType(type) { }
+		   MatchMap&& 					mmap) : mStartLoc(startLoc), mEndLoc(endLoc), mType(type) { }
 
 	const clang::SourceLocation& getStartLocation() const { return mStartLoc; }
 	const clang::SourceLocation& getEndLocation() const { return mEndLoc; }
+
+	/**
+	 * Returns the positions of the start and of the end of the pragma, used to compare the
+	 * pragma with the AST nodes (they are not set until the pragma is registered with the parser)
+	 */
+	const Position& getStartPosition() const { return mStartPos; }
+	const Position& getEndPosition() const { return mEndPos; }
+
 	/**
 	 * Returns a string which identifies the pragma
 	 */
@@ -111,6 +133,7 @@ public:
 
 private:
 	clang::SourceLocation mStartLoc, mEndLoc;
+	Position mStartPos, mEndPos;
 	std::string mType;
 	PragmaTarget mTargetNode;
 };
@@ -118,6 +141,101 @@ private:
 typedef std::shared_ptr<Pragma> PragmaPtr;
 typedef std::vector<PragmaPtr> 	PragmaList;
 
+// ------------------------------------ PragmaInfo ---------------------------
+/**
+ * Describes a pragma without referring to the AST: the type of the pragma, its location,
+ * the range of the node it is attached to (if any) and the values of its clauses as text.
+ * The information is self-contained, it can outlive the compiler which produced it.
+ */
+class PragmaInfo {
+public:
+	typedef std::map<std::string, std::vector<std::string>> ClauseMap;
+
+	/**
+	 * How the text of a clause value has been obtained: the spelling of the matched 
+	 * tokens (e.g. a keyword), the name of a variable or the source of an expression
+	 */
+	enum ValueKind { VALUE_SPELLING, VALUE_VARIABLE, VALUE_EXPRESSION };
+	typedef std::map<std::string, std::vector<ValueKind>> ValueKindMap;
+
+	enum TargetKind { TARGET_NONE, TARGET_STMT, TARGET_DECL };
+
+	/**
+	 * Creates the description of a pragma matched in lexer mode, all values are spellings
+	 */
+	PragmaInfo(const std::string& 			type, 
+			   const clang::SourceLocation& startLoc, 
+			   const clang::SourceLocation& endLoc, 
+			   const clang::SourceManager& 	sm, 
+			   const MatchMap& 				mmap);
+
+	/**
+	 * Creates the description of a parsed pragma, variables and expressions of the 
+	 * matcher map are resolved to their name and to their source text
+	 */
+	PragmaInfo(const Pragma& 				pragma, 
+			   const MatchMap& 				mmap,
+			   const clang::SourceManager& 	sm, 
+			   const clang::LangOptions& 	LO);
+
+	const std::string& getType() const { return mType; }
+	const std::string& getFileName() const { return mFileName; }
+	unsigned getLine() const { return mLine; }
+	unsigned getColumn() const { return mColumn; }
+
+	/**
+	 * Returns the file offsets of the beginning and of the end of the pragma
+	 */
+	unsigned getStartOffset() const { return mStartOffset; }
+	unsigned getEndOffset() const { return mEndOffset; }
+
+	/**
+	 * Returns the kind of node the pragma was attached to and the file offsets of its range
+	 */
+	TargetKind getTargetKind() const { return mTargetKind; }
+	unsigned getTargetStart() const { return mTargetStart; }
+	unsigned getTargetEnd() const { return mTargetEnd; }
+
+	/**
+	 * Returns, for each key of the pragma matcher, the list of matched values
+	 */
+	const ClauseMap& getClauses() const { return mClauses; }
+
+	/**
+	 * Returns, for each key of the pragma matcher, the kind of the matched values
+	 */
+	const ValueKindMap& getValueKinds() const { return mValueKinds; }
+
+	/**
+	 * Writes the pragma in the form: file:line:col: type key(value, ...) ...
+	 */
+	std::ostream& printTo(std::ostream& out) const;
+
+	/**
+	 * Writes all the fields of the description in a form which can be read back by readFrom
+	 */
+	void writeTo(std::ostream& out) const;
+
+	/**
+	 * Reads a description written by writeTo and appends it to the list, false is returned 
+	 * if the input is malformed
+	 */
+	static bool readFrom(std::istream& in, PragmaInfoList& list);
+
+private:
+	PragmaInfo(): mLine(0), mColumn(0), mStartOffset(0), mEndOffset(0), 
+				  mTargetKind(TARGET_NONE), mTargetStart(0), mTargetEnd(0) { }
+
+	std::string mType;
+	std::string mFileName;
+	unsigned 	mLine, mColumn;
+	unsigned 	mStartOffset, mEndOffset;
+	TargetKind 	mTargetKind;
+	unsigned 	mTargetStart, mTargetEnd;
+	ClauseMap 	mClauses;
+	ValueKindMap mValueKinds;
+};
+
 // ------------------------------------ PragmaStmtMap ---------------------------
 /**
  * Maps statements and declarations to a Pragma.
@@ -154,7 +272,8 @@ private:
  */
 template<class T>
 class BasicPragmaHandler: public clang::PragmaHandler {
-	node* pragma_matcher;
+	// matchers are never modified once built, therefore they can be shared among handlers
+	std::shared_ptr<const node> pragma_matcher;
 	std::string base_name;
 
 public:
@@ -164,10 +283,18 @@ public:
 		: PragmaHandler(name->getName().str()), 
 		  pragma_matcher(pragma_matcher.copy()), base_name(base_name) { }
 
+	BasicPragmaHandler(clang::IdentifierInfo* 				name, 
+					   const std::shared_ptr<const node>& 	pragma_matcher, 
+					   const std::string& 					base_name = std::string()) 
+		: PragmaHandler(name->getName().str()), 
+		  pragma_matcher(pragma_matcher), base_name(base_name) { }
+
 	void HandlePragma(clang::Preprocessor& 			PP, 
 					  clang::PragmaIntroducerKind 	kind, 
 					  clang::Token& 				FirstToken) 
 	{
+		PhaseTimer timer(&ParseStats::matchTime);
+
 		// '#' symbol is 1 position before
 		clang::SourceLocation&& startLoc = 
 			ParserProxy::get().CurrentToken().getLocation().getLocWithOffset(-1);
@@ -176,6 +303,7 @@ public:
 		ParserStack errStack;
 
 		if ( pragma_matcher->MatchPragma(PP, mmap, errStack) ) {
+			countStat(&ParseStats::pragmas);
 			// the pragma type is formed by concatenation of the base_name and identifier, for
 			// example the type for the pragma:
 			//		#pragma omp barrier
@@ -188,20 +316,26 @@ public:
 				pragma_name << getName().str();
 
 			clang::SourceLocation endLoc = ParserProxy::get().CurrentToken().getLocation();
+
+			// in lexer mode there is no AST to attach the pragma to, its description is
+			// simply added to the inventory
+			if (PragmaInfoList* inventory = ParserProxy::get().getInventory()) {
+				inventory->push_back( PragmaInfo(pragma_name.str(), startLoc, endLoc, PP.getSourceManager(), mmap) );
+				return;
+			}
+
 			// the pragma has been successfully parsed, now we have to instantiate the correct type
-			// which is associated to this pragma (T) and pass the matcher map in order for the
-			// pragma to initialize his internal representation. The framework will then take care
+			// which is associated to this pragma (T) and move the matcher map into it in order for 
+			// the pragma to initialize his internal representation. The framework will then take care
 			// of associating the pragma to the following node (i.e. a statement or a declaration).
 			static_cast<ClompSema&>(ParserProxy::get().getParser()->getActions()).
-				ActOnPragma<T>( pragma_name.str(), mmap, startLoc, endLoc );
+				ActOnPragma<T>( pragma_name.str(), std::move(mmap), startLoc, endLoc );
 			return;
 		}
 		// In case of error, we report it to the console using the clang Diagnostics.
 		errorReport(PP, startLoc, errStack);
 		PP.DiscardUntilEndOfDirective();
 	}
-
-	~BasicPragmaHandler() {	delete pragma_matcher; }
 };
 
 // ------------------------------------ PragmaHandlerFactory ---------------------------
@@ -215,6 +349,18 @@ struct PragmaHandlerFactory {
 	{
 		return new BasicPragmaHandler<T> (name, re, base_name);
 	}
+
+	/**
+	 * Creates a handler which shares the matcher re (which is not copied)
+	 */
+	template<class T>
+	static clang::PragmaHandler* CreatePragmaHandler(
+			clang::IdentifierInfo* name, 
+			const std::shared_ptr<const node>& re, 
+			const std::string& base_name = std::string())
+	{
+		return new BasicPragmaHandler<T> (name, re, base_name);
+	}
 };
 
 } // end clomp namespace
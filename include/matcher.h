@@ -7,21 +7,28 @@
 #pragma once
 
 #include "driver/compiler.h"
+#include "utils/stats.h"
 
 #include <memory>
 #include <algorithm>
 #include <string>
 #include <vector>
+#include <utility>
 #include <map>
+#include <set>
+#include <mutex>
+#include <cassert>
 
 #include <clang/Lex/Token.h>
+#include <clang/Lex/Preprocessor.h>
 #include <clang/Basic/SourceLocation.h>
 
-#include <llvm/ADT/PointerUnion.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
 
 // forward declarations
 namespace clang {
-class Preprocessor;
 class Stmt;
 class ASTContext;
 class SourceLocation;
@@ -34,6 +41,10 @@ namespace clomp {
  * Data structure used for error reporting due to unmatched pragmas.
  * Choice points generated new records which are allocated in a stack-like data
  * structure.
+ *
+ * The records are only kept once recording is started: a pragma is first matched 
+ * without any bookkeeping and it is matched again, recording, only if it fails 
+ * (see node::MatchPragma).
  */
 class ParserStack {
 public:
@@ -52,7 +63,14 @@ public:
 
 	typedef std::vector<Error> LocErrorList;
 
-	ParserStack(): mRecordId(0) { }
+	ParserStack(): mRecordId(0), mRecording(false) { }
+
+	bool isRecording() const { return mRecording; }
+
+	/**
+	 * Discards the records (if any) and starts recording the errors
+	 */
+	void startRecording();
 
 	size_t openRecord();
 
@@ -69,6 +87,7 @@ public:
 	size_t stackSize() const { return mRecords.size(); }
 private:
 	size_t mRecordId;
+	bool mRecording;
 	std::vector<LocErrorList> mRecords;
 };
 
@@ -92,59 +111,217 @@ struct option;
  * Two kind of tokens can be stored, strings (which usually results from parsing
  * of keywords) and clang AST nodes (stmt) which are instead extracted when
  * identifiers, expressions are parsed.
+ *
+ * A value does not own what it refers to: AST nodes are allocated by the ASTContext,
+ * strings refer to the identifier table, to the source buffers or to the static 
+ * spellings of the tokens. The few strings which have no owner (e.g. the spelling of 
+ * an expression in lexer mode) are copied in the arena of the preprocessor, therefore 
+ * values are valid as long as the translation unit which produced them.
  */
-class ValueUnion: public llvm::PointerUnion<clang::Stmt*, std::string*> {
-	bool ptrOwner;
-	clang::ASTContext* clangCtx;
+class ValueUnion {
+	clang::Stmt* 		mStmt;
+	llvm::StringRef 	mStr;
+	clang::ASTContext* 	clangCtx;
+	bool 				mIsStmt;
 
 public:
 	ValueUnion(clang::Stmt* stmt, clang::ASTContext* ctx) :
-		llvm::PointerUnion<clang::Stmt*, std::string*>(stmt), ptrOwner(true), clangCtx(ctx) { }
+		mStmt(stmt), clangCtx(ctx), mIsStmt(true) { }
 
-	ValueUnion(std::string const& str) :
-		llvm::PointerUnion<clang::Stmt*, std::string*>(new std::string(str)), 
-		ptrOwner(true), clangCtx(NULL) { }
+	explicit ValueUnion(llvm::StringRef str) :
+		mStmt(NULL), mStr(str), clangCtx(NULL), mIsStmt(false) { }
 
-	ValueUnion(ValueUnion& other, bool transferOwnership=false) :
-		llvm::PointerUnion<clang::Stmt*, std::string*>(other), ptrOwner(true), clangCtx(other.clangCtx) {
-		if(transferOwnership) 	other.ptrOwner = false;
-		else	ptrOwner = false;
+	bool isStmt() const { return mIsStmt; }
+	bool isString() const { return !mIsStmt; }
+
+	clang::Stmt* getStmt() const { 
+		assert(isStmt() && "Value is not an AST node");
+		return mStmt; 
 	}
 
-	/**
-	 * A ValueUnion instance always owns the internal value. This method transfer the ownership to the owner.
-	 */
-	template<class T>
-	T take() {
-		T ret = get<T> ();
-		if (ret) ptrOwner = false;
-		return ret;
+	llvm::StringRef getString() const { 
+		assert(isString() && "Value is not a string");
+		return mStr; 
 	}
 
 	std::ostream& printTo(std::ostream& out) const;
 
 	std::string toStr() const;
-	~ValueUnion();
 };
 
-typedef std::shared_ptr<ValueUnion> ValueUnionPtr;
-typedef std::vector<ValueUnionPtr> ValueList;
+/**
+ * The values matched for a key, most clauses have a single value which is stored inline
+ */
+typedef llvm::SmallVector<ValueUnion, 2> ValueList;
 
-// forward declarations
-class MatchMap: public std::map<std::string, ValueList> {
+// ------------------------------------ MatchKey ---------------------------
+/**
+ * Identifier of a key of the matcher map. The names of the keys are registered when the grammar
+ * is built and they are given consecutive ids, the matcher map is indexed by them.
+ */
+typedef unsigned MatchKey;
+
+/**
+ * Process wide registry of the keys of the matcher map
+ */
+struct MatchKeyRegistry {
+	static const MatchKey NoKey = ~0u;
+
+	/**
+	 * Returns the id of the key with the given name, it is registered the first time
+	 */
+	static MatchKey get(const std::string& name);
+
+	/**
+	 * Returns the id of the key with the given name, NoKey if it was never registered
+	 */
+	static MatchKey lookup(const std::string& name);
+
+	/**
+	 * Returns the key of a map name given to a node, NoKey for the empty name (i.e. the values 
+	 * matched by the node are not stored)
+	 */
+	static MatchKey keyOf(const std::string& name) { return name.empty() ? NoKey : get(name); }
+
+	static const std::string& getName(MatchKey key);
+};
+
+/**
+ * Values matched by a pragma, grouped by key. The entries are stored in a vector (in the order in
+ * which the keys are matched) and a table indexed by the key ids gives their position: a lookup
+ * by id costs an array access. Both tables and the value lists have inline storage, a pragma with
+ * a few single valued clauses is matched and stored without any heap allocation.
+ */
+class MatchMap {
 public:
-	typedef std::map<std::string, ValueList>::value_type value_type;
-	typedef std::map<std::string, ValueList>::key_type key_type;
+	typedef std::pair<MatchKey, ValueList> 		value_type;
+	typedef llvm::SmallVector<value_type, 4> 	EntryList;
+	typedef EntryList::iterator 				iterator;
+	typedef EntryList::const_iterator 			const_iterator;
+
+	MatchMap() { }
+
+	/**
+	 * The values are moved from other, which is left empty
+	 */
+	MatchMap(MatchMap&& other) { swap(other); }
+	MatchMap& operator=(MatchMap&& other) { 
+		MatchMap(std::move(other)).swap(*this);
+		return *this;
+	}
+
+	void swap(MatchMap& other) {
+		mEntries.swap(other.mEntries);
+		mSlots.swap(other.mSlots);
+	}
+
+	/**
+	 * Returns the values of the key, the key is added if it is not in the map
+	 */
+	ValueList& operator[](MatchKey key);
+
+	const_iterator find(MatchKey key) const;
+	const_iterator find(const std::string& key) const { return find(MatchKeyRegistry::lookup(key)); }
 
-	MatchMap() {}
-	MatchMap(const MatchMap& other);
+	size_t count(MatchKey key) const { return find(key) != end(); }
+	size_t count(const std::string& key) const { return find(key) != end(); }
+
+	const_iterator begin() const { return mEntries.begin(); }
+	const_iterator end() const { return mEntries.end(); }
+	iterator begin() { return mEntries.begin(); }
+	iterator end() { return mEntries.end(); }
+
+	bool empty() const { return mEntries.empty(); }
+	size_t size() const { return mEntries.size(); }
+
+	static const std::string& getKeyName(MatchKey key) { return MatchKeyRegistry::getName(key); }
+
+	/**
+	 * Returns the bytes allocated on the heap by the map, i.e. by the tables and the value lists 
+	 * which outgrew their inline storage
+	 */
+	size_t getAllocatedSize() const;
 
 	std::ostream& printTo(std::ostream& out) const;
+
+private:
+	// Make this class noncopyable, the match result is moved from the matcher to the pragma
+	MatchMap(const MatchMap&);
+	MatchMap& operator=(const MatchMap&);
+
+	EntryList 								mEntries;
+	// position + 1 of the entry of each key in mEntries, 0 if the key is not in the map
+	llvm::SmallVector<unsigned char, 32> 	mSlots;
 };
 
 typedef std::pair<bool, MatchMap> MatcherResult;
 template<clang::tok::TokenKind T> struct Tok;
 
+// ------------------------------------ FirstSet ---------------------------
+/**
+ * The tokens which can start a match of a node (its FIRST set). Identifiers expected by a
+ * keyword are distinguished by their spelling.
+ */
+struct FirstSet {
+	std::set<std::string> 				keywords;
+	std::set<clang::tok::TokenKind> 	tokens;
+	// any identifier (e.g. a variable name)
+	bool anyIdentifier;
+	// any token, used when the set is not known (e.g. for expressions)
+	bool anyToken;
+	// the node can match without consuming any token
+	bool nullable;
+
+	FirstSet(): anyIdentifier(false), anyToken(false), nullable(false) { }
+
+	/**
+	 * Adds the tokens of other to this set, the set is nullable if any of them is
+	 */
+	void merge(const FirstSet& other);
+
+	/**
+	 * Returns true if a match of the node can start with (or without consuming) the token
+	 */
+	bool contains(const clang::Token& token) const;
+};
+
+// ------------------------------------ DispatchTable ---------------------------
+/**
+ * Maps the leading token of the input to the alternatives of a chain of choices which can 
+ * start with it, the table is built from the FIRST sets of the alternatives. The candidates 
+ * are the indexes of the alternatives in increasing order. Identifiers are looked up by 
+ * their spelling in a hash table. 
+ *
+ * Used by both the runtime (see choice) and the static (see grammar::choice) matchers.
+ */
+class DispatchTable {
+	// candidates for an identifier, by spelling
+	llvm::StringMap<std::vector<unsigned>> mKeywords;
+	// candidates for an identifier which is not a keyword of any alternative
+	std::vector<unsigned> mIdentifiers;
+	// candidates for the other tokens, by kind
+	std::map<clang::tok::TokenKind, std::vector<unsigned>> mTokens;
+	// candidates for the tokens which start none of the alternatives
+	std::vector<unsigned> mOthers;
+	// tokens expected by each alternative, reported when the alternative is not tried
+	std::vector<std::vector<std::string>> mExpected;
+
+	// Make this class noncopyable
+	DispatchTable(const DispatchTable&);
+
+public:
+	explicit DispatchTable(const std::vector<FirstSet>& firsts);
+
+	/**
+	 * Returns the alternatives which can start with token
+	 */
+	const std::vector<unsigned>& getCandidates(const clang::Token& token) const;
+
+	const std::vector<std::string>& getExpected(unsigned alternative) const { return mExpected[alternative]; }
+
+	size_t size() const { return mExpected.size(); }
+};
+
 // ------------------------------------ pragma matcher ---------------------------
 /**
  * A node is a abstract class representing a generic node of the matching tree
@@ -165,6 +342,11 @@ struct node {
 
 	virtual node* copy() const = 0;
 
+	/**
+	 * Returns the FIRST set of the node, by default a node can start with any token
+	 */
+	virtual FirstSet getFirst() const;
+
 	/**
 	 * The semantics of the >> operator is redefined to implement "followed-by". n1 >> n2 means that
 	 * node n1 is followed by node n2.
@@ -191,9 +373,12 @@ struct node {
 	 */
 	virtual node& operator[](const std::string& map_name) = 0;
 
-	bool MatchPragma(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack) {
-		return match(PP, mmap, errStack, errStack.openRecord());
-	}
+	/**
+	 * Matches a whole pragma. Unless errStack is already recording, the pragma is first matched
+	 * without recording any error; if this fails, the tokens are backtracked and the pragma is
+	 * matched again recording the expected tokens in errStack (as needed by errorReport).
+	 */
+	bool MatchPragma(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack) const;
 
 	virtual ~node() { }
 };
@@ -248,15 +433,32 @@ struct concat: public val_pair<concat> {
 	concat(node const& n1, node const& n2) : val_pair<concat>::val_pair(n1.copy(), n2.copy()) {	}
 
 	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const;
+	FirstSet getFirst() const;
 };
 
 /**
- * Implements the choice ('|') semantics
+ * Implements the choice ('|') semantics. A chain of choices (n1 | n2 | ... | nk) is matched 
+ * predictively: the first time it is used, a table mapping the leading token to the alternatives 
+ * which can start with it is built from their FIRST sets (see DispatchTable). Only those 
+ * alternatives are tried (in order), the others would fail on the first token.
  */
 struct choice: public val_pair<choice> {
-	choice(node const& n1, node const& n2) : val_pair<choice>::val_pair(n1.copy(), n2.copy()) {	}
+	// defined out of line, where the dispatch table is a complete type
+	choice(node const& n1, node const& n2);
+	choice(const choice& other);
+	~choice();
 
 	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const;
+	FirstSet getFirst() const;
+
+private:
+	struct Dispatch;
+
+	// built once, the first time the choice is matched (the grammar is shared among threads)
+	mutable std::once_flag 				mDispatchInit;
+	mutable std::unique_ptr<Dispatch> 	mDispatch;
+
+	void buildDispatch() const;
 };
 
 /**
@@ -266,6 +468,7 @@ struct option: public val_single<option> {
 	option(node const& n): val_single<option>(n.copy()) { }
 
 	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const;
+	FirstSet getFirst() const;
 };
 
 /**
@@ -275,6 +478,7 @@ struct star: public val_single<star> {
 	star(node const& n) : val_single<star>(n.copy()) { }
 
 	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const;
+	FirstSet getFirst() const;
 };
 
 /**
@@ -285,14 +489,16 @@ struct star: public val_single<star> {
 template <class T>
 class MappableNode: public node {
 	std::string mapName;
+	MatchKey mapKey;
 	bool addToMap;
 
 public:
 	MappableNode(std::string const& str=std::string(), bool addToMap=true) 
-		: mapName(str), addToMap(addToMap) { }
+		: mapName(str), mapKey(MatchKeyRegistry::keyOf(str)), addToMap(addToMap) { }
 
 	node& operator[](const std::string& str) {
 		mapName = str;
+		mapKey = MatchKeyRegistry::keyOf(str);
 		return *this;
 	}
 
@@ -304,6 +510,10 @@ public:
 	T operator~() const { return T( getMapName(), false); }
 
 	const std::string& getMapName() const { return mapName; }
+	/**
+	 * Returns the id of the map key, MatchKeyRegistry::NoKey if no key has been assigned
+	 */
+	MatchKey getMapKey() const { return mapKey; }
 	bool isAddToMap() const { return addToMap; }
 };
 
@@ -319,6 +529,47 @@ struct expr_p: public MappableNode<expr_p> {
 	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const;
 };
 
+/**
+ * Matches an expression (see expr_p) and adds it to the matcher map with the given key, nothing
+ * is added if the key is MatchKeyRegistry::NoKey
+ */
+bool matchExpression(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID, MatchKey key);
+
+/**
+ * Matches a token of the given kind (see Tok), when addToMap is set the token is added to the 
+ * matcher map with the given key (see AddToMap)
+ */
+bool matchToken(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID, 
+				clang::tok::TokenKind kind, bool resolve, MatchKey key, bool addToMap);
+
+/**
+ * Matches an identifier spelled as kw (see kwd). When addToMap is set its spelling is added to 
+ * the matcher map with the given key, an empty entry with key kwKey is added if key is NoKey
+ */
+bool matchKeyword(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID, 
+				  const std::string& kw, MatchKey kwKey, MatchKey key, bool addToMap);
+
+/**
+ * Matches first followed by second (see concat), the tokens are restored if either fails. 
+ * The nodes can be runtime or static (see grammar.h) nodes.
+ */
+template <class L, class R>
+bool matchConcat(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, const L& first, const R& second) {
+	size_t id = errStack.openRecord();
+	PP.EnableBacktrackAtThisPos();
+	if (first.match(PP, mmap, errStack, id)) {
+		errStack.discardPrevRecords(id);
+		id = errStack.openRecord();
+		if (second.match(PP, mmap, errStack, id)) {
+			PP.CommitBacktrackedTokens();
+			errStack.discardRecord(id);
+			return true;
+		}
+	}
+	PP.Backtrack();
+	countStat(&ParseStats::backtracks);
+	return false;
+}
 
 /**
  * Utility function for adding a token with a specific key to the matcher map.
@@ -326,12 +577,18 @@ struct expr_p: public MappableNode<expr_p> {
 void AddToMap(clang::tok::TokenKind tok, 
 			  clang::Token const& 	token, 
 			  bool 					resolve, 
-			  std::string const& 	map_str, 
+			  MatchKey 				key, 
 			  MatchMap& 			mmap);
 
 std::string TokenToStr(clang::tok::TokenKind tok);
 std::string TokenToStr(const clang::Token& token);
 
+/**
+ * Returns the spelling of a token without copying it: literals refer to the source buffer and 
+ * the other tokens to their static spelling
+ */
+llvm::StringRef TokenSpelling(const clang::Token& token);
+
 /**
  * This class represents a wrapper for clang basic tokens.
  */
@@ -351,15 +608,15 @@ struct Tok: public MappableNode<Tok<T>> {
 	}
 
 	virtual bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
-		clang::Token& token = ParserProxy::get().ConsumeToken();
-		if (token.is(T)) {
-			if (MappableNode<Tok<T>>::isAddToMap()) { 
-				AddToMap(T, token, resolve, MappableNode<Tok<T>>::getMapName(), mmap); 
-			}
-			return true;
-		}
-		errStack.addExpected(recID, ParserStack::Error("\'" + TokenToStr(T) + "\'", token.getLocation()));
-		return false;
+		return matchToken(PP, mmap, errStack, recID, T, resolve, 
+						  MappableNode<Tok<T>>::getMapKey(), MappableNode<Tok<T>>::isAddToMap());
+	}
+
+	FirstSet getFirst() const {
+		FirstSet first;
+		if (T == clang::tok::identifier) { first.anyIdentifier = true; }
+		else { first.tokens.insert(T); }
+		return first;
 	}
 };
 
@@ -368,14 +625,22 @@ struct Tok: public MappableNode<Tok<T>> {
  */
 struct kwd: public Tok<clang::tok::identifier> {
 	std::string kw;
+	// key used when the keyword has no map name
+	MatchKey kwKey;
 
-	kwd(std::string const& kw) : Tok<clang::tok::identifier>(), kw(kw) { }
+	kwd(std::string const& kw) : Tok<clang::tok::identifier>(), kw(kw), kwKey(MatchKeyRegistry::get(kw)) { }
 	kwd(std::string const& kw, std::string const& map_str, bool addToMap=true) :
-		Tok<clang::tok::identifier>(map_str, addToMap), kw(kw) { }
+		Tok<clang::tok::identifier>(map_str, addToMap), kw(kw), kwKey(MatchKeyRegistry::get(kw)) { }
 
 	node* copy() const { return new kwd(kw, getMapName(), isAddToMap()); }
 	kwd operator~() const { return kwd(kw, getMapName(), false); }
 	bool match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const;
+
+	FirstSet getFirst() const {
+		FirstSet first;
+		first.keywords.insert(kw);
+		return first;
+	}
 };
 
 /**
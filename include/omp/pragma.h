@@ -29,7 +29,7 @@ public:
 	OmpPragma(const clang::SourceLocation&  startLoc, 
 			  const clang::SourceLocation&  endLoc, 
 			  const std::string& 			name, 
-			  const MatchMap& 				mmap);
+			  MatchMap&& 					mmap);
 
 	const MatchMap& getMap() const { return mMap; }
 
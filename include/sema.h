@@ -24,6 +24,27 @@ typedef std::vector<PragmaPtr> 	PragmaList;
 
 class MatchMap;
 
+// ------------------------------------ PragmaConsumer ---------------------------
+/**
+ * Receives the pragmas of a translation unit while it is being parsed. A pragma is handed
+ * over as soon as it has been attached to its statement or declaration, the pragmas which 
+ * cannot be attached to any node are handed over at the end of the translation unit.
+ */
+class PragmaConsumer {
+public:
+	/**
+	 * Invoked once, before the parsing starts, with the context of the translation unit
+	 */
+	virtual void Initialize(clang::ASTContext& Context) { }
+
+	/**
+	 * Invoked for every pragma of the translation unit
+	 */
+	virtual void HandlePragma(const PragmaPtr& pragma) = 0;
+
+	virtual ~PragmaConsumer() { }
+};
+
 /**
  * This purpose of this class is to overload the behavior of clang parser in a
  * way every time an AST node is created, pending pragmas are correctly
@@ -35,11 +56,17 @@ class ClompSema: public clang::Sema {
 
 	bool isInsideFunctionDef;
 
+	// sets up the parser to skip the body of the function being defined when it contains no pragmas
+	void skipBodyIfPragmaFree();
+
 	void matchStmt(clang::Stmt* 				S, 
 				   const clang::SourceRange& 	bounds, 
 				   const clang::SourceManager& 	sm, 
 				   PragmaList& 					matched);
 
+	// removes the matched pragmas from the pending ones and hands them over to the consumer
+	void pragmasMatched(const PragmaList& matched);
+
 	ClompSema(const Sema& other);
 
 public:
@@ -54,6 +81,24 @@ public:
 
 	void addPragma(PragmaPtr P);
 
+	/**
+	 * Streams the pragmas to the consumer instead of collecting them into the pragma list
+	 */
+	void setPragmaConsumer(PragmaConsumer* consumer);
+
+	/**
+	 * Hands the pragmas which have not been attached to any node over to the consumer, 
+	 * to be called once the whole translation unit has been parsed
+	 */
+	void flushPendingPragmas();
+
+	/**
+	 * Enables the skipping of function bodies which contain no pragmas, the functions
+	 * are declared but their bodies are not parsed. Must be called before the main 
+	 * source file is entered.
+	 */
+	void enableBodySkipping();
+
 	clang::StmtResult ActOnCompoundStmt(clang::SourceLocation 	L, 
 										clang::SourceLocation 	R, 
 										clang::MultiStmtArg 	Elts, 
@@ -89,15 +134,15 @@ public:
 	void ActOnTagFinishDefinition(clang::Scope* S, clang::Decl* TagDecl, clang::SourceLocation RBraceLoc);
 
 	/**
-	 * Register the parsed pragma.
+	 * Register the parsed pragma, the values matched by the pragma matcher are moved into it.
 	 */
 	template <class T>
 	void ActOnPragma(const std::string& 		name, 
-					 const MatchMap& 			mmap, 
+					 MatchMap&& 				mmap, 
 					 clang::SourceLocation 		startLoc, 
 					 clang::SourceLocation 		endLoc) 
 	{
-		addPragma( std::make_shared<T>(startLoc, endLoc, name, mmap) );
+		addPragma( std::make_shared<T>(startLoc, endLoc, name, std::move(mmap)) );
 	}
 	
 	/**
@@ -0,0 +1,155 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <ostream>
+
+namespace clomp {
+
+// ------------------------------------ ParseStats ---------------------------
+/**
+ * Wall times (in seconds) and counters collected while a translation unit is processed.
+ *
+ * The collection is enabled for the current thread by a StatsScope. When it is disabled
+ * the probes placed in the parser only test a thread local pointer.
+ */
+struct ParseStats {
+	double prescanTime;		// pre-scan of the input files
+	double setupTime;		// creation of the compiler instance
+	double parseTime;		// parsing of the translation unit (preprocessing included)
+	double preprocessTime;	// lexing of the input in lexer mode (no AST is built)
+	double matchTime;		// pragma matchers (part of the parsing or of the preprocessing)
+	double semaTime;		// association of the pragmas to the AST nodes (part of the parsing)
+
+	unsigned pragmas;			// pragmas successfully matched
+	unsigned backtracks;		// backtracks of the pragma matchers
+	unsigned lineLookups;		// line numbers computed (utils::Line)
+	unsigned compoundRebuilds;	// compound statements rebuilt to attach a pragma
+
+	ParseStats();
+
+	ParseStats& operator+=(const ParseStats& other);
+
+	/**
+	 * Writes the statistics on a single line, times are reported in milliseconds
+	 */
+	std::ostream& printTo(std::ostream& out) const;
+
+	/**
+	 * Returns the statistics collected by the current thread, NULL if the collection is disabled
+	 */
+	static ParseStats* current() { return currStats; }
+
+private:
+	static thread_local ParseStats* currStats;
+	friend class StatsScope;
+};
+
+/**
+ * Collects the statistics of the current thread into stats during the lifetime of the
+ * scope, a NULL stats disables the collection.
+ */
+class StatsScope {
+	ParseStats* mPrev;
+
+	// Make this class noncopyable
+	StatsScope(const StatsScope&);
+
+public:
+	StatsScope(ParseStats* stats): mPrev(ParseStats::currStats) { ParseStats::currStats = stats; }
+	~StatsScope() { ParseStats::currStats = mPrev; }
+};
+
+/**
+ * Adds the wall time elapsed during its lifetime to one of the times of the current statistics
+ */
+class PhaseTimer {
+	typedef std::chrono::steady_clock clock;
+
+	ParseStats* 		mStats;
+	double ParseStats::* mField;
+	clock::time_point 	mStart;
+
+	// Make this class noncopyable
+	PhaseTimer(const PhaseTimer&);
+
+public:
+	PhaseTimer(double ParseStats::* field): mStats(ParseStats::current()), mField(field) {
+		if (mStats) { mStart = clock::now(); }
+	}
+
+	~PhaseTimer() {
+		if (mStats) { mStats->*mField += std::chrono::duration<double>(clock::now() - mStart).count(); }
+	}
+};
+
+/**
+ * Increments one of the counters of the current statistics
+ */
+inline void countStat(unsigned ParseStats::* field, unsigned n = 1) {
+	if (ParseStats* stats = ParseStats::current()) { stats->*field += n; }
+}
+
+// ------------------------------------ MemoryStats ---------------------------
+/**
+ * Memory (in bytes) used by a translation unit. The figures of the data structures are
+ * measured once the parsing is completed, before the translation unit is detached.
+ *
+ * The RSS deltas refer to the whole process: they are exact when translation units are
+ * built one at a time (e.g. by the workers of the batch driver) and only indicative when
+ * several translation units are parsed concurrently by the same process. The peak is 
+ * the process-wide one and it is never reset by the library: unless the owner of the 
+ * process resets it (see MemoryUsage::resetPeak) before building the translation unit, 
+ * peakRSSDelta may include memory used before.
+ */
+struct MemoryStats {
+	size_t astBytes;		// allocated by the ASTContext (bump allocator and side tables)
+	size_t matchBytes;		// heap storage of the MatchMap of the pragmas (inline storage, AST nodes and spellings excluded)
+	size_t pragmaBytes;		// pragma objects attached to the AST
+	long peakRSSDelta;		// peak resident set size of the process minus the size before building the translation unit
+	long retainedRSSDelta;	// growth of the resident set size once the translation unit is built
+
+	MemoryStats();
+
+	/**
+	 * Writes the figures on a single line, sizes are reported in KiB
+	 */
+	std::ostream& printTo(std::ostream& out) const;
+};
+
+/**
+ * Resident set size of the process, read from /proc/self/status
+ */
+struct MemoryUsage {
+	size_t rss;
+	size_t peakRSS;
+
+	/**
+	 * Returns the current usage, both sizes are zero if they cannot be read
+	 */
+	static MemoryUsage current();
+
+	/**
+	 * Resets the peak resident set size to the current one, returns false when this is
+	 * not supported (the peak then keeps the maximum reached since the process started)
+	 */
+	static bool resetPeak();
+};
+
+/**
+ * Returns the number of bytes allocated on the heap by a string, zero when the 
+ * characters are stored inside the object itself
+ */
+inline size_t allocatedSize(const std::string& str) {
+	const char* data = str.data();
+	const char* obj = reinterpret_cast<const char*>(&str);
+	return (data >= obj && data < obj + sizeof(str)) ? 0 : str.capacity() + 1;
+}
+
+} // end clomp namespace
@@ -0,0 +1,373 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#include "driver/batch.h"
+#include "driver/program.h"
+#include "driver/cache.h"
+#include "utils/stats.h"
+
+#include "handler.h"
+#include "omp/pragma.h"
+#include "omp/annotation.h"
+
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <cassert>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+using namespace clomp;
+
+namespace {
+
+// status codes sent back by the workers
+enum ResultStatus { RESULT_OK = 0, RESULT_ERROR = 1 };
+
+// every result starts with this header followed by 'length' bytes of output
+struct ResultHeader {
+	uint32_t index;
+	uint32_t status;
+	uint32_t length;
+};
+
+bool writeAll(int fd, const void* data, size_t size) {
+	const char* ptr = static_cast<const char*>(data);
+	while (size) {
+		ssize_t ret = ::write(fd, ptr, size);
+		if (ret < 0 && errno == EINTR) { continue; }
+		if (ret <= 0) { return false; }
+		ptr += ret;
+		size -= ret;
+	}
+	return true;
+}
+
+bool readAll(int fd, void* data, size_t size) {
+	char* ptr = static_cast<char*>(data);
+	while (size) {
+		ssize_t ret = ::read(fd, ptr, size);
+		if (ret < 0 && errno == EINTR) { continue; }
+		if (ret <= 0) { return false; }
+		ptr += ret;
+		size -= ret;
+	}
+	return true;
+}
+
+/*
+ * Parses a single entry of the batch and writes the report to the output 
+ * stream, returns false if the translation unit could not be parsed.
+ */
+bool processEntry(std::ostream& out, const BatchEntry& entry, bool inventory, const ResultCache* cache) {
+	// timings and memory figures differ at every run, reports with statistics are not cached
+	const bool stats = entry.options.collectStats;
+	if (stats || entry.options.collectMemory) { cache = NULL; }
+
+	std::string key;
+	if (cache) {
+		std::string cached;
+		key = ResultCache::makeKey(inventory ? "inventory" : "pragmas", entry.file, entry.options);
+		if (cache->lookup(key, cached)) {
+			out << cached;
+			return true;
+		}
+	}
+
+	std::ostringstream ss;
+	std::vector<FileDependency> deps;
+	ss << entry.file << "\n";
+	try {
+		if (inventory) {
+			ParseStats inventoryStats;
+			StatsScope scope(stats ? &inventoryStats : NULL);
+			printInventory(ss, collectPragmas(entry.file, entry.options, &deps));
+			if (stats) { inventoryStats.printTo(ss << "stats: ") << "\n"; }
+		} else {
+			Program p;
+			TranslationUnit& tu = p.addTranslationUnit(entry.file, entry.options);
+			printPragmas(ss, tu);
+			if (stats) { tu.getStats().printTo(ss << "stats: ") << "\n"; }
+			if (entry.options.collectMemory) { tu.getMemoryStats().printTo(ss << "memory: ") << "\n"; }
+			deps = tu.getDependencies();
+		}
+	} catch (const std::exception& e) {
+		out << ss.str() << "error: unable to parse translation unit: " << e.what() << "\n";
+		return false;
+	}
+
+	const std::string&& report = ss.str();
+	// errors are not cached, they are reported again by the next run
+	if (cache) { cache->store(key, deps, report); }
+	out << report;
+	return true;
+}
+
+/*
+ * Body of a worker process: reads the index of the next file to process from
+ * the command pipe and writes back the result until the command pipe is closed.
+ */
+void workerLoop(const std::vector<BatchEntry>& entries, bool inventory, const ResultCache* cache, int cmdFd, int resFd) {
+	uint32_t idx;
+	while (readAll(cmdFd, &idx, sizeof(idx))) {
+		assert(idx < entries.size());
+
+		// the worker owns the process, the peak of the previous file must not be reported
+		if (entries[idx].options.collectMemory) { MemoryUsage::resetPeak(); }
+
+		std::ostringstream ss;
+		ResultHeader hdr = { idx, RESULT_OK, 0 };
+		if (!processEntry(ss, entries[idx], inventory, cache)) { hdr.status = RESULT_ERROR; }
+
+		std::string&& res = ss.str();
+		hdr.length = res.size();
+		if ( !writeAll(resFd, &hdr, sizeof(hdr)) || !writeAll(resFd, res.data(), res.size()) ) {
+			return;
+		}
+	}
+}
+
+} // end anonymous namespace
+
+namespace clomp {
+
+unsigned printPragmas(std::ostream& out, const TranslationUnit& tu) {
+	// without the AST the pragmas cannot be converted into annotations
+	if (tu.isDetached()) { return printInventory(out, tu.getPragmaInfos()); }
+
+	unsigned c=0;
+	const PragmaList& pl = tu.getPragmaList();
+	for(auto it = pl.begin(), end = pl.end(); it != end; ++it) {
+		if (std::shared_ptr<omp::OmpPragma> omp_pragma =
+				std::dynamic_pointer_cast<omp::OmpPragma>(*it))
+		{
+			out << "OmpPragma: " << *omp_pragma->toAnnotation() << "\n";
+			c++;
+		}
+	}
+	out << c << " OpenMP pragmas" << "\n";
+	return c;
+}
+
+unsigned printInventory(std::ostream& out, const PragmaInfoList& inventory) {
+	unsigned c=0;
+	for(auto it = inventory.begin(), end = inventory.end(); it != end; ++it) {
+		// only pragmas of the omp namespace are reported
+		if (it->getType().compare(0, 5, "omp::") == 0) {
+			it->printTo(out << "OmpPragma: ") << "\n";
+			c++;
+		}
+	}
+	out << c << " OpenMP pragmas" << "\n";
+	return c;
+}
+
+BatchDriver::BatchDriver(const std::vector<BatchEntry>& entries, unsigned jobs, bool inventory) :
+	mEntries(entries), mJobs(jobs), mInventory(inventory) { }
+
+unsigned BatchDriver::run(std::ostream& out) {
+	return mJobs ? runWorkers(out) : runInProcess(out);
+}
+
+unsigned BatchDriver::runInProcess(std::ostream& out) {
+	// size of the output buffer after which the output is written out
+	const size_t flushThreshold = 1 << 20;
+
+	unsigned failed = 0;
+	std::ostringstream buffer;
+	for (auto it = mEntries.begin(), end = mEntries.end(); it != end; ++it) {
+		if (!processEntry(buffer, *it, mInventory, mCache.get())) { ++failed; }
+
+		if (buffer.tellp() >= static_cast<std::streamoff>(flushThreshold)) {
+			out << buffer.str();
+			buffer.str("");
+		}
+	}
+	out << buffer.str();
+	out.flush();
+	return failed;
+}
+
+unsigned BatchDriver::runWorkers(std::ostream& out) {
+
+	struct Worker {
+		pid_t 		pid;
+		int 		cmdFd, resFd;
+		long 		current;	// index of the file being processed (-1 if idle)
+		std::string buffer;		// partially received result
+	};
+
+	const size_t numFiles = mEntries.size();
+	std::vector<std::string> results(numFiles);
+	std::vector<bool> done(numFiles, false);
+	size_t nextFile = 0, nextOut = 0;
+	unsigned failed = 0;
+
+	std::vector<Worker> workers;
+
+	// a worker dying while we send a command must not kill the driver
+	signal(SIGPIPE, SIG_IGN);
+
+	// the output produced so far by the parent must not be duplicated by the children
+	out.flush();
+
+	auto spawn = [&] () -> bool {
+		int cmd[2], res[2];
+		if (pipe(cmd) != 0) { return false; }
+		if (pipe(res) != 0) { close(cmd[0]); close(cmd[1]); return false; }
+
+		pid_t pid = fork();
+		if (pid < 0) {
+			close(cmd[0]); close(cmd[1]); close(res[0]); close(res[1]);
+			return false;
+		}
+		if (pid == 0) {
+			// child: drop the pipes of the other workers
+			std::for_each(workers.begin(), workers.end(), [](const Worker& cur) {
+				close(cur.cmdFd);
+				close(cur.resFd);
+			});
+			close(cmd[1]);
+			close(res[0]);
+			// anything printed directly on the standard output by the parser would
+			// mix up with the merged output, the results only travel through the pipe
+			int devNull = open("/dev/null", O_WRONLY);
+			if (devNull >= 0) { dup2(devNull, STDOUT_FILENO); close(devNull); }
+
+			workerLoop(mEntries, mInventory, mCache.get(), cmd[0], res[1]);
+			_exit(0);
+		}
+
+		close(cmd[0]);
+		close(res[1]);
+		Worker w = { pid, cmd[1], res[0], -1, std::string() };
+		workers.push_back(w);
+		return true;
+	};
+
+	// sends the next file to the worker, or closes its command pipe if there is nothing left
+	auto assign = [&] (Worker& w) {
+		w.current = -1;
+		if (nextFile < numFiles) {
+			uint32_t idx = nextFile;
+			if (writeAll(w.cmdFd, &idx, sizeof(idx))) {
+				w.current = nextFile++;
+				return;
+			}
+		}
+		if (w.cmdFd >= 0) { close(w.cmdFd); w.cmdFd = -1; }
+	};
+
+	auto complete = [&] (size_t idx, const std::string& res, bool success) {
+		results[idx] = res;
+		done[idx] = true;
+		if (!success) { ++failed; }
+		// write the results which are ready following the input order
+		for (; nextOut < numFiles && done[nextOut]; ++nextOut) {
+			out << results[nextOut];
+			std::string().swap(results[nextOut]);
+		}
+		out.flush();
+	};
+
+	for (unsigned i = 0; i < std::min<size_t>(mJobs, numFiles); ++i) {
+		if (!spawn()) { break; }
+		assign(workers.back());
+	}
+
+	while (!workers.empty()) {
+
+		std::vector<pollfd> fds(workers.size());
+		for (size_t i = 0; i < workers.size(); ++i) {
+			fds[i].fd = workers[i].resFd;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+
+		if (poll(&fds.front(), fds.size(), -1) < 0) {
+			if (errno == EINTR) { continue; }
+			break;
+		}
+
+		std::vector<Worker> alive;
+		bool respawn = false;
+		for (size_t i = 0; i < workers.size(); ++i) {
+			Worker& w = workers[i];
+			if (!fds[i].revents) { alive.push_back(w); continue; }
+
+			char buf[4096];
+			ssize_t n = ::read(w.resFd, buf, sizeof(buf));
+			if (n < 0 && errno == EINTR) { alive.push_back(w); continue; }
+
+			bool garbled = false;
+			if (n > 0) {
+				w.buffer.append(buf, n);
+				// extract all the complete results received so far
+				while (w.buffer.size() >= sizeof(ResultHeader)) {
+					ResultHeader hdr;
+					std::memcpy(&hdr, w.buffer.data(), sizeof(hdr));
+					// only the file assigned to the worker can be reported
+					if (static_cast<long>(hdr.index) != w.current) { garbled = true; break; }
+					if (w.buffer.size() < sizeof(hdr) + hdr.length) { break; }
+
+					complete(hdr.index, w.buffer.substr(sizeof(hdr), hdr.length), hdr.status == RESULT_OK);
+					w.buffer.erase(0, sizeof(hdr) + hdr.length);
+					assign(w);
+				}
+				if (!garbled) {
+					alive.push_back(w);
+					continue;
+				}
+				// the stream cannot be trusted anymore, the worker is handled as a crashed one
+				kill(w.pid, SIGKILL);
+			}
+
+			// end of stream: the worker either finished or died
+			int status = 0;
+			waitpid(w.pid, &status, 0);
+			close(w.resFd);
+			if (w.cmdFd >= 0) { close(w.cmdFd); }
+
+			if (w.current >= 0) {
+				std::ostringstream ss;
+				ss << mEntries[w.current].file << std::endl << "error: worker ";
+				if (garbled) {
+					ss << "sent a malformed result";
+				} else if (WIFSIGNALED(status)) {
+					ss << "terminated by signal " << WTERMSIG(status);
+				} else {
+					ss << "exited with status " << WEXITSTATUS(status);
+				}
+				ss << std::endl;
+				complete(w.current, ss.str(), false);
+				respawn = true;
+			}
+		}
+		workers.swap(alive);
+
+		// replace the crashed workers if there are files left to process
+		if (respawn) {
+			while (workers.size() < mJobs && nextFile < numFiles && spawn()) {
+				assign(workers.back());
+			}
+		}
+	}
+
+	// files which could not be assigned (e.g. because fork failed)
+	for (size_t idx = nextFile; idx < numFiles; ++idx) {
+		complete(idx, mEntries[idx].file + "\nerror: unable to spawn a worker process\n", false);
+	}
+	return failed;
+}
+
+} // end clomp namespace
@@ -0,0 +1,217 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#include "driver/cache.h"
+
+#include <sstream>
+#include <iomanip>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdio>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace clomp;
+
+namespace {
+
+// to be increased whenever the content of the results or the record layout changes
+const char* const recordMagic = "clomp-cache 2";
+
+const uint64_t FNVPrime = 1099511628211ULL;
+
+std::string toHex(uint64_t value) {
+	std::ostringstream ss;
+	ss << std::hex << std::setw(16) << std::setfill('0') << value;
+	return ss.str();
+}
+
+bool hashFile(const std::string& path, uint64_t& hash) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) { return false; }
+
+	char buf[1 << 16];
+	hash = hashBuffer(buf, buf);
+	ssize_t ret;
+	while ((ret = ::read(fd, buf, sizeof(buf))) != 0) {
+		if (ret < 0 && errno == EINTR) { continue; }
+		if (ret < 0) { ::close(fd); return false; }
+		hash = hashBuffer(buf, buf + ret, hash);
+	}
+	::close(fd);
+	return true;
+}
+
+bool readFile(const std::string& path, std::string& content) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) { return false; }
+
+	char buf[1 << 16];
+	ssize_t ret;
+	content.clear();
+	while ((ret = ::read(fd, buf, sizeof(buf))) != 0) {
+		if (ret < 0 && errno == EINTR) { continue; }
+		if (ret < 0) { ::close(fd); return false; }
+		content.append(buf, ret);
+	}
+	::close(fd);
+	return true;
+}
+
+/*
+ * Reads the records fields, each method returns false if the record is malformed
+ */
+class RecordReader {
+	const std::string& mData;
+	size_t mPos;
+public:
+	RecordReader(const std::string& data): mData(data), mPos(0) { }
+
+	bool line(std::string& value) {
+		size_t end = mData.find('\n', mPos);
+		if (end == std::string::npos) { return false; }
+		value = mData.substr(mPos, end - mPos);
+		mPos = end+1;
+		return true;
+	}
+
+	bool number(size_t& value) {
+		std::string str;
+		if (!line(str) || str.empty()) { return false; }
+		char* end;
+		value = strtoul(str.c_str(), &end, 10);
+		return *end == '\0';
+	}
+
+	// a block of size bytes followed by a newline
+	bool block(std::string& value) {
+		size_t size;
+		if (!number(size) || mData.size() - mPos < size + 1 || mData[mPos + size] != '\n') { return false; }
+		value = mData.substr(mPos, size);
+		mPos += size+1;
+		return true;
+	}
+};
+
+template <class Container>
+void appendList(std::string& key, const char* tag, const Container& values) {
+	key.append(tag).append(1, '\0');
+	for (auto it = values.begin(), end = values.end(); it != end; ++it) {
+		key.append(*it).append(1, '\0');
+	}
+}
+
+} // end anonymous namespace
+
+namespace clomp {
+
+uint64_t hashBuffer(const char* begin, const char* end, uint64_t seed) {
+	uint64_t hash = seed;
+	for (const char* it = begin; it != end; ++it) {
+		hash ^= static_cast<unsigned char>(*it);
+		hash *= FNVPrime;
+	}
+	return hash;
+}
+
+ResultCache::ResultCache(const std::string& dir): mDir(dir) {
+	if (::mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+		throw CacheError("unable to create cache directory " + dir);
+	}
+	struct stat st;
+	if (::stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+		throw CacheError(dir + " is not a directory");
+	}
+}
+
+std::string ResultCache::makeKey(const std::string& kind, const std::string& fileName, const CompilerOptions& options) {
+	// the language and target settings are fixed by ClangCompiler (or derived from the
+	// file name), therefore the version of the record covers them
+	std::string key(recordMagic);
+	key.append(1, '\0').append(kind).append(1, '\0').append(fileName).append(1, '\0');
+
+	appendList(key, "-I", options.includePaths);
+	appendList(key, "-iquote", options.quoteIncludePaths);
+	appendList(key, "-isystem", options.systemIncludePaths);
+	appendList(key, "-D", options.definitions);
+	appendList(key, "-U", options.undefinitions);
+	for (auto it = options.virtualFiles.begin(), end = options.virtualFiles.end(); it != end; ++it) {
+		key.append("virtual").append(1, '\0').append(it->name).append(1, '\0');
+		key.append(toHex(hashBuffer(it->content.data(), it->content.data() + it->content.size())));
+	}
+	key.append(options.prescan ? "prescan" : "").append(1, '\0');
+	key.append(options.skipFunctionBodies ? "skip-bodies" : "").append(1, '\0');
+	return key;
+}
+
+std::string ResultCache::recordPath(const std::string& key) const {
+	return mDir + "/" + toHex(hashBuffer(key.data(), key.data() + key.size()));
+}
+
+bool ResultCache::lookup(const std::string& key, std::string& output, std::vector<FileDependency>* dependencies) const {
+	std::string data;
+	if (!readFile(recordPath(key), data)) { return false; }
+
+	RecordReader reader(data);
+	std::string magic, storedKey;
+	size_t numDeps;
+	if (!reader.line(magic) || magic != recordMagic || !reader.block(storedKey) || storedKey != key) {
+		return false;
+	}
+	if (!reader.number(numDeps)) { return false; }
+
+	std::vector<FileDependency> deps;
+	for (size_t i = 0; i < numDeps; ++i) {
+		std::string dep;
+		uint64_t hash;
+		if (!reader.line(dep) || dep.size() < 17 || dep[16] != ' ') { return false; }
+		if (!hashFile(dep.substr(17), hash) || toHex(hash) != dep.substr(0, 16)) { return false; }
+		deps.push_back( FileDependency(dep.substr(17), hash) );
+	}
+	if (!reader.block(output)) { return false; }
+	if (dependencies) { dependencies->swap(deps); }
+	return true;
+}
+
+bool ResultCache::store(const std::string& key, const std::vector<FileDependency>& dependencies, const std::string& output) const {
+	std::ostringstream ss;
+	ss << recordMagic << "\n" << key.size() << "\n" << key << "\n" << dependencies.size() << "\n";
+	for (auto it = dependencies.begin(), end = dependencies.end(); it != end; ++it) {
+		if (it->name.find('\n') != std::string::npos) { return false; }
+		ss << toHex(it->hash) << " " << it->name << "\n";
+	}
+	ss << output.size() << "\n" << output << "\n";
+
+	// the record is made visible atomically, readers never see a partial record
+	static std::atomic<unsigned> counter(0);
+	std::ostringstream tmp;
+	tmp << mDir << "/.tmp." << getpid() << "." << counter++;
+	const std::string&& tmpPath = tmp.str();
+
+	int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) { return false; }
+
+	const std::string&& record = ss.str();
+	size_t done = 0;
+	while (done < record.size()) {
+		ssize_t ret = ::write(fd, record.data() + done, record.size() - done);
+		if (ret < 0 && errno == EINTR) { continue; }
+		if (ret <= 0) { break; }
+		done += ret;
+	}
+	::close(fd);
+
+	if (done != record.size() || ::rename(tmpPath.c_str(), recordPath(key).c_str()) != 0) {
+		::unlink(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+} // end clomp namespace
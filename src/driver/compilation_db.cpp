@@ -0,0 +1,286 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#include "driver/compilation_db.h"
+
+#include <fstream>
+#include <sstream>
+#include <cctype>
+
+using namespace clomp;
+
+namespace {
+
+bool isAbsolute(const std::string& path) { return !path.empty() && path[0] == '/'; }
+
+std::string makeAbsolute(const std::string& dir, const std::string& path) {
+	if (isAbsolute(path) || dir.empty()) { return path; }
+	return dir[dir.size()-1] == '/' ? dir + path : dir + '/' + path;
+}
+
+/**
+ * A minimal JSON reader, only the subset needed by the compilation database
+ * format is turned into values (objects of strings and arrays of strings),
+ * everything else is validated and skipped.
+ */
+class JSONReader {
+	const std::string& 	text;
+	size_t 				pos;
+
+	void error(const std::string& msg) const {
+		std::ostringstream ss;
+		ss << "malformed compilation database at offset " << pos << ": " << msg;
+		throw CompilationDatabaseError(ss.str());
+	}
+
+	void skipSpaces() {
+		while (pos < text.size() && isspace(static_cast<unsigned char>(text[pos]))) { ++pos; }
+	}
+
+	char peek() {
+		skipSpaces();
+		if (pos == text.size()) { error("unexpected end of input"); }
+		return text[pos];
+	}
+
+	void expect(char c) {
+		if (peek() != c) { error(std::string("expected '") + c + "'"); }
+		++pos;
+	}
+
+	static void appendUTF8(std::string& out, unsigned cp) {
+		if (cp < 0x80) {
+			out += static_cast<char>(cp);
+		} else if (cp < 0x800) {
+			out += static_cast<char>(0xC0 | (cp >> 6));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		} else if (cp < 0x10000) {
+			out += static_cast<char>(0xE0 | (cp >> 12));
+			out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		} else {
+			out += static_cast<char>(0xF0 | (cp >> 18));
+			out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		}
+	}
+
+	unsigned readHex4() {
+		if (pos + 4 > text.size()) { error("truncated unicode escape"); }
+		unsigned cp = 0;
+		for (size_t i = 0; i < 4; ++i) {
+			char c = text[pos++];
+			cp <<= 4;
+			if (c >= '0' && c <= '9') 		cp |= c - '0';
+			else if (c >= 'a' && c <= 'f') 	cp |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') 	cp |= c - 'A' + 10;
+			else error("invalid unicode escape");
+		}
+		return cp;
+	}
+
+public:
+	JSONReader(const std::string& text): text(text), pos(0) { }
+
+	bool atEnd() { skipSpaces(); return pos == text.size(); }
+
+	std::string readString() {
+		expect('"');
+		std::string ret;
+		while (true) {
+			if (pos == text.size()) { error("unterminated string"); }
+			char c = text[pos++];
+			if (c == '"') { return ret; }
+			if (c != '\\') { ret += c; continue; }
+
+			if (pos == text.size()) { error("unterminated string"); }
+			switch (char e = text[pos++]) {
+			case 'n': ret += '\n'; break;
+			case 't': ret += '\t'; break;
+			case 'r': ret += '\r'; break;
+			case 'b': ret += '\b'; break;
+			case 'f': ret += '\f'; break;
+			case 'u': {
+				unsigned cp = readHex4();
+				// surrogate pair
+				if (cp >= 0xD800 && cp < 0xDC00 && text.compare(pos, 2, "\\u") == 0) {
+					pos += 2;
+					unsigned low = readHex4();
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+				}
+				appendUTF8(ret, cp);
+				break;
+			}
+			default: ret += e;
+			}
+		}
+	}
+
+	/**
+	 * Skips any JSON value
+	 */
+	void skipValue() {
+		char c = peek();
+		if (c == '"') { readString(); return; }
+		if (c == '{') {
+			readObject([&](const std::string&) { skipValue(); });
+			return;
+		}
+		if (c == '[') {
+			readArray([&]() { skipValue(); });
+			return;
+		}
+		// number, true, false or null
+		size_t start = pos;
+		while (pos < text.size() && (isalnum(static_cast<unsigned char>(text[pos])) ||
+					text[pos] == '-' || text[pos] == '+' || text[pos] == '.')) { ++pos; }
+		if (start == pos) { error("unexpected character"); }
+	}
+
+	/**
+	 * Reads an object, for each member the callback is invoked with the key, the
+	 * callback is responsible for reading the value.
+	 */
+	template <class Callback>
+	void readObject(const Callback& member) {
+		expect('{');
+		if (peek() == '}') { ++pos; return; }
+		while (true) {
+			std::string key = readString();
+			expect(':');
+			member(key);
+			if (peek() == '}') { ++pos; return; }
+			expect(',');
+		}
+	}
+
+	/**
+	 * Reads an array, the callback is invoked for each element and is responsible
+	 * for reading it.
+	 */
+	template <class Callback>
+	void readArray(const Callback& element) {
+		expect('[');
+		if (peek() == ']') { ++pos; return; }
+		while (true) {
+			element();
+			if (peek() == ']') { ++pos; return; }
+			expect(',');
+		}
+	}
+};
+
+} // end anonymous namespace
+
+namespace clomp {
+
+std::vector<std::string> splitCommandLine(const std::string& cmd) {
+	std::vector<std::string> args;
+	std::string cur;
+	bool inArg = false;
+	char quote = 0;
+
+	for (size_t i = 0; i < cmd.size(); ++i) {
+		char c = cmd[i];
+		if (quote == '\'') {
+			if (c == '\'') 	quote = 0;
+			else 			cur += c;
+			continue;
+		}
+		if (quote == '"') {
+			if (c == '"') { quote = 0; continue; }
+			if (c == '\\' && i+1 < cmd.size() &&
+				(cmd[i+1] == '"' || cmd[i+1] == '\\' || cmd[i+1] == '$' || cmd[i+1] == '`')) {
+				c = cmd[++i];
+			}
+			cur += c;
+			continue;
+		}
+		if (isspace(static_cast<unsigned char>(c))) {
+			if (inArg) { args.push_back(cur); cur.clear(); inArg = false; }
+			continue;
+		}
+		inArg = true;
+		if (c == '\'' || c == '"') 	{ quote = c; continue; }
+		if (c == '\\' && i+1 < cmd.size()) { c = cmd[++i]; }
+		cur += c;
+	}
+	if (inArg) { args.push_back(cur); }
+	return args;
+}
+
+std::string CompileCommand::getFilePath() const {
+	return makeAbsolute(directory, file);
+}
+
+CompilerOptions CompileCommand::getCompilerOptions() const {
+	CompilerOptions opts;
+
+	// handles both the joined (-Ifoo) and separated (-I foo) forms of an option
+	auto value = [&](size_t& i, const std::string& flag, std::string& val) -> bool {
+		const std::string& arg = arguments[i];
+		if (arg.compare(0, flag.size(), flag) != 0) { return false; }
+		if (arg.size() > flag.size()) { val = arg.substr(flag.size()); return true; }
+		if (i+1 < arguments.size()) 	{ val = arguments[++i]; return true; }
+		return false;
+	};
+
+	for (size_t i = 1; i < arguments.size(); ++i) {
+		std::string val;
+		if (value(i, "-isystem", val)) {
+			opts.systemIncludePaths.push_back( makeAbsolute(directory, val) );
+		} else if (value(i, "-iquote", val)) {
+			opts.quoteIncludePaths.push_back( makeAbsolute(directory, val) );
+		} else if (value(i, "-I", val)) {
+			opts.includePaths.push_back( makeAbsolute(directory, val) );
+		} else if (value(i, "-D", val)) {
+			opts.definitions.push_back( val );
+		} else if (value(i, "-U", val)) {
+			opts.undefinitions.push_back( val );
+		}
+	}
+	return opts;
+}
+
+CompileCommandList loadCompilationDatabase(const std::string& fileName) {
+	std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+	if (!in) {
+		throw CompilationDatabaseError("unable to open compilation database: " + fileName);
+	}
+	std::ostringstream ss;
+	ss << in.rdbuf();
+	std::string text = ss.str();
+
+	CompileCommandList cmds;
+	JSONReader reader(text);
+	reader.readArray([&]() {
+		CompileCommand cmd;
+		std::string command;
+		reader.readObject([&](const std::string& key) {
+			if (key == "directory") 	 	{ cmd.directory = reader.readString(); }
+			else if (key == "file") 		{ cmd.file = reader.readString(); }
+			else if (key == "command") 		{ command = reader.readString(); }
+			else if (key == "arguments") {
+				reader.readArray([&]() { cmd.arguments.push_back( reader.readString() ); });
+			}
+			else { reader.skipValue(); }
+		});
+		// the "arguments" form has precedence over "command"
+		if (cmd.arguments.empty()) { cmd.arguments = splitCommandLine(command); }
+		if (cmd.file.empty()) {
+			throw CompilationDatabaseError("compilation database entry without a file: " + fileName);
+		}
+		cmds.push_back(cmd);
+	});
+
+	if (!reader.atEnd()) {
+		throw CompilationDatabaseError("trailing data in compilation database: " + fileName);
+	}
+	return cmds;
+}
+
+} // end clomp namespace
@@ -5,6 +5,7 @@
 // License. See LICENSE.TXT for details.
 //=============================================================================
 #include "driver/compiler.h"
+#include "driver/cache.h"
 #include "utils/config.h"
 #include "sema.h"
 
@@ -17,6 +18,7 @@
 #include "clang/Basic/TargetInfo.h"
 
 #include "llvm/LLVMContext.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/ADT/IntrusiveRefCntPtr.h"
 
 #include "llvm/Config/config.h"
@@ -28,13 +30,23 @@
 #include "clang/Parse/Parser.h"
 
 #include <iostream>
+#include <algorithm>
 
 using namespace clomp;
 using namespace clang;
 
-ParserProxy* ParserProxy::currParser = NULL;
+thread_local ParserProxy* ParserProxy::currParser = NULL;
+
+ParserProxy::ParserProxy(clang::Preprocessor& PP, clomp::PragmaInfoList& inventory) : 
+	mParser(NULL), mPP(&PP), mTok(new Token), mInventory(&inventory) 
+{
+	mTok->startToken();
+}
+
+ParserProxy::~ParserProxy() { delete mTok; }
 
 clang::Expr* ParserProxy::ParseExpression(clang::Preprocessor& PP) {
+	assert(mParser && "Expressions cannot be parsed in lexer mode");
 	PP.Lex(mParser->Tok);
 
 	Parser::ExprResult ownedResult = mParser->ParseExpression();
@@ -47,17 +59,25 @@ void ParserProxy::EnterTokenStream(clang::Preprocessor& PP) {
 }
 
 Token& ParserProxy::ConsumeToken() {
+	if (!mParser) {
+		mPP->Lex(*mTok);
+		return *mTok;
+	}
 	mParser->ConsumeAnyToken();
 	// Token token = PP.LookAhead(0);
 	return CurrentToken();
 }
 
 clang::Scope* ParserProxy::CurrentScope() {
-	return mParser->getCurScope();
+	return mParser ? mParser->getCurScope() : NULL;
 }
 
 Token& ParserProxy::CurrentToken() {
-	return mParser->Tok;
+	return mParser ? mParser->Tok : *mTok;
+}
+
+void ParserProxy::SkipFunctionBodies(bool skip) {
+	if (mParser) { mParser->SkipFunctionBodies = skip; }
 }
 
 namespace {
@@ -93,7 +113,29 @@ struct ClangCompiler::ClangCompilerImpl {
 	ClangCompilerImpl(): TO(new TargetOptions) { }
 };
 
-ClangCompiler::ClangCompiler(const std::string& file_name) : pimpl(new ClangCompilerImpl) {
+ClangCompiler::ClangCompiler(const std::string& file_name, const CompilerOptions& options) : 
+	pimpl(new ClangCompilerImpl) 
+{
+	try {
+		init(file_name, options, NULL);
+	} catch(...) {
+		delete pimpl;
+		throw;
+	}
+}
+
+ClangCompiler::ClangCompiler(const VirtualFile& input, const CompilerOptions& options) : 
+	pimpl(new ClangCompilerImpl) 
+{
+	try {
+		init(input.name, options, &input);
+	} catch(...) {
+		delete pimpl;
+		throw;
+	}
+}
+
+void ClangCompiler::init(const std::string& file_name, const CompilerOptions& options, const VirtualFile* input) {
 
 	setDiagnosticClient(pimpl->clang);
 
@@ -110,10 +152,38 @@ ClangCompiler::ClangCompiler(const std::string& file_name) : pimpl(new ClangComp
 	pimpl->clang.getHeaderSearchOpts().UseStandardSystemIncludes = 1;  // Includes system includes, usually  /usr/include
 	pimpl->clang.getHeaderSearchOpts().UseStandardCXXIncludes = 0;
 
+	// Add user provided include paths
+	HeaderSearchOptions& HSO = pimpl->clang.getHeaderSearchOpts();
+	std::for_each(options.includePaths.begin(), options.includePaths.end(), [&](const std::string& cur) {
+		HSO.AddPath(cur, clang::frontend::Angled, true, false, false);
+	});
+	std::for_each(options.quoteIncludePaths.begin(), options.quoteIncludePaths.end(), [&](const std::string& cur) {
+		HSO.AddPath(cur, clang::frontend::Quoted, true, false, false);
+	});
+	std::for_each(options.systemIncludePaths.begin(), options.systemIncludePaths.end(), [&](const std::string& cur) {
+		HSO.AddPath(cur, clang::frontend::System, true, false, false);
+	});
+
 	// Add default header 
 	pimpl->clang.getHeaderSearchOpts().AddPath (CLANG_SYSTEM_INCLUDE_FOLDER,
 			 									clang::frontend::System, true, false, false);
 
+	// Macros defined/undefined by the user, definitions are processed first
+	PreprocessorOptions& PO = pimpl->clang.getPreprocessorOpts();
+	std::for_each(options.definitions.begin(), options.definitions.end(), [&](const std::string& cur) {
+		PO.addMacroDef(cur);
+	});
+	std::for_each(options.undefinitions.begin(), options.undefinitions.end(), [&](const std::string& cur) {
+		PO.addMacroUndef(cur);
+	});
+
+	// Files held in memory, the source manager takes the ownership of the buffers
+	auto remap = [&](const VirtualFile& cur) {
+		PO.addRemappedFile(cur.name, llvm::MemoryBuffer::getMemBufferCopy(cur.content, cur.name));
+	};
+	std::for_each(options.virtualFiles.begin(), options.virtualFiles.end(), remap);
+	if (input) { remap(*input); }
+
 	// fix the target architecture to be a 64 bit machine
 	pimpl->TO->Triple = llvm::Triple("x86_64", "PC", "Linux").getTriple();
 	// TO.Triple = llvm::sys::getHostTriple();
@@ -150,10 +220,11 @@ ClangCompiler::ClangCompiler(const std::string& file_name) : pimpl(new ClangComp
 			getPreprocessor().getLangOpts()
 	);
 
-	std::cout << file_name << std::endl;
-
+	// virtual files are registered in the file manager when the preprocessor is created
 	const FileEntry *FileIn = pimpl->clang.getFileManager().getFile(file_name, true);
-	assert(FileIn && "file not found");
+	if (!FileIn) {
+		throw ClangParsingError(file_name);
+	}
 	pimpl->clang.getSourceManager().createMainFileID(FileIn);
 	pimpl->clang.getDiagnosticClient().BeginSourceFile(
 											pimpl->clang.getLangOpts(),
@@ -176,6 +247,22 @@ TargetInfo& ClangCompiler::getTargetInfo() const {
 	return pimpl->clang.getTarget(); 
 }
 
+std::vector<FileDependency> ClangCompiler::getDependencies() const {
+	std::vector<FileDependency> files;
+	SourceManager& SM = pimpl->clang.getSourceManager();
+	for (auto it = SM.fileinfo_begin(), end = SM.fileinfo_end(); it != end; ++it) {
+		// the content of a file is hashed as it was parsed, a file whose content has 
+		// never been loaded did not contribute to the translation unit
+		const llvm::MemoryBuffer* buffer = it->second->getRawBuffer();
+		if (!buffer) { continue; }
+		files.push_back( FileDependency(it->first->getName(), hashBuffer(buffer->getBufferStart(), buffer->getBufferEnd())) );
+	}
+	std::sort(files.begin(), files.end(), [](const FileDependency& lhs, const FileDependency& rhs) { 
+		return lhs.name < rhs.name; 
+	});
+	return files;
+}
+
 ClangCompiler::~ClangCompiler() {
 	pimpl->clang.getDiagnostics().getClient()->EndSourceFile();
 	delete pimpl;
@@ -0,0 +1,286 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#include "driver/index.h"
+#include "driver/program.h"
+
+#include "handler.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+using namespace clomp;
+
+namespace {
+
+const char IndexMagic[8] = { 'C', 'L', 'O', 'M', 'P', 'I', 'D', 'X' };
+
+// every table starts at an offset which is a multiple of the alignment
+const uint64_t TableAlignment = 8;
+
+uint64_t align(uint64_t offset) {
+	return (offset + TableAlignment - 1) & ~(TableAlignment - 1);
+}
+
+/*
+ * Collects the tables of the index in memory before they are written out
+ */
+class IndexBuilder {
+	std::unordered_map<std::string, uint32_t> 	mStringIds;
+	std::vector<index::StringEntry> 			mStrings;
+	std::string 								mChars;
+
+public:
+	std::vector<index::PragmaEntry> pragmas;
+	std::vector<index::ClauseEntry> clauses;
+	std::vector<index::ValueEntry> 	values;
+
+	uint32_t intern(const std::string& str) {
+		auto fit = mStringIds.find(str);
+		if (fit != mStringIds.end()) { return fit->second; }
+
+		index::StringEntry entry = { static_cast<uint32_t>(mChars.size()), static_cast<uint32_t>(str.size()) };
+		mChars.append(str);
+		mStrings.push_back(entry);
+		return mStringIds[str] = mStrings.size()-1;
+	}
+
+	void addPragma(const PragmaInfo& pragma);
+
+	void writeTo(std::ostream& out) const;
+};
+
+index::ValueKind toIndexKind(PragmaInfo::ValueKind kind) {
+	switch (kind) {
+	case PragmaInfo::VALUE_VARIABLE: 	return index::VALUE_VARIABLE;
+	case PragmaInfo::VALUE_EXPRESSION: 	return index::VALUE_EXPRESSION;
+	default: 							return index::VALUE_STRING;
+	}
+}
+
+index::TargetKind toIndexKind(PragmaInfo::TargetKind kind) {
+	switch (kind) {
+	case PragmaInfo::TARGET_STMT: 	return index::TARGET_STMT;
+	case PragmaInfo::TARGET_DECL: 	return index::TARGET_DECL;
+	default: 						return index::TARGET_NONE;
+	}
+}
+
+void IndexBuilder::addPragma(const PragmaInfo& pragma) {
+
+	index::PragmaEntry entry;
+	std::memset(&entry, 0, sizeof(entry));
+	entry.type 			= intern(pragma.getType());
+	entry.file 			= intern(pragma.getFileName());
+	entry.line 			= pragma.getLine();
+	entry.column 		= pragma.getColumn();
+	entry.startOffset 	= pragma.getStartOffset();
+	entry.endOffset 	= pragma.getEndOffset();
+	entry.targetKind 	= toIndexKind(pragma.getTargetKind());
+	entry.targetStart 	= pragma.getTargetStart();
+	entry.targetEnd 	= pragma.getTargetEnd();
+
+	entry.firstClause = clauses.size();
+	const PragmaInfo::ClauseMap& clauseMap = pragma.getClauses();
+	const PragmaInfo::ValueKindMap& kindMap = pragma.getValueKinds();
+	for (auto it = clauseMap.begin(), end = clauseMap.end(); it != end; ++it) {
+		index::ClauseEntry clause = { intern(it->first), static_cast<uint32_t>(values.size()), 0 };
+
+		auto kit = kindMap.find(it->first);
+		assert(kit != kindMap.end() && kit->second.size() == it->second.size());
+		for (size_t i = 0; i < it->second.size(); ++i) {
+			index::ValueEntry value = { toIndexKind(kit->second[i]), intern(it->second[i]) };
+			values.push_back(value);
+		}
+		clause.numValues = values.size() - clause.firstValue;
+		clauses.push_back(clause);
+	}
+	entry.numClauses = clauses.size() - entry.firstClause;
+	pragmas.push_back(entry);
+}
+
+template <class T>
+void writeTable(std::ostream& out, uint64_t& pos, uint64_t offset, const std::vector<T>& table) {
+	assert(offset >= pos);
+	for (; pos < offset; ++pos) { out.put('\0'); }
+	if (!table.empty()) {
+		out.write(reinterpret_cast<const char*>(&table.front()), table.size() * sizeof(T));
+	}
+	pos += table.size() * sizeof(T);
+}
+
+void IndexBuilder::writeTo(std::ostream& out) const {
+	index::Header hdr;
+	std::memset(&hdr, 0, sizeof(hdr));
+	std::memcpy(hdr.magic, IndexMagic, sizeof(IndexMagic));
+	hdr.version 	= index::Version;
+	hdr.byteOrder 	= index::ByteOrderMark;
+	hdr.numStrings 	= mStrings.size();
+	hdr.numPragmas 	= pragmas.size();
+	hdr.numClauses 	= clauses.size();
+	hdr.numValues 	= values.size();
+
+	hdr.stringsOffset 	= align(sizeof(hdr));
+	hdr.pragmasOffset 	= align(hdr.stringsOffset + mStrings.size() * sizeof(index::StringEntry));
+	hdr.clausesOffset 	= align(hdr.pragmasOffset + pragmas.size() * sizeof(index::PragmaEntry));
+	hdr.valuesOffset 	= align(hdr.clausesOffset + clauses.size() * sizeof(index::ClauseEntry));
+	hdr.charsOffset 	= align(hdr.valuesOffset + values.size() * sizeof(index::ValueEntry));
+	hdr.charsSize 		= mChars.size();
+
+	out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+	uint64_t pos = sizeof(hdr);
+	writeTable(out, pos, hdr.stringsOffset, mStrings);
+	writeTable(out, pos, hdr.pragmasOffset, pragmas);
+	writeTable(out, pos, hdr.clausesOffset, clauses);
+	writeTable(out, pos, hdr.valuesOffset, values);
+	for (; pos < hdr.charsOffset; ++pos) { out.put('\0'); }
+	out.write(mChars.data(), mChars.size());
+}
+
+} // end anonymous namespace
+
+namespace clomp {
+
+unsigned writePragmaIndex(std::ostream& out, const Program& prog) {
+
+	// translation units are kept in a set of pointers, they are sorted by name so
+	// that the index does not depend on the memory layout
+	std::vector<TranslationUnitPtr> tus(prog.getTranslationUnits().begin(), prog.getTranslationUnits().end());
+	std::sort(tus.begin(), tus.end(), [](const TranslationUnitPtr& lhs, const TranslationUnitPtr& rhs) {
+		return lhs->getFileName() < rhs->getFileName();
+	});
+
+	IndexBuilder builder;
+	for (auto it = tus.begin(), end = tus.end(); it != end; ++it) {
+		// the pragmas of detached translation units are already in their self-contained form
+		if ((*it)->isDetached()) {
+			const PragmaInfoList& infos = (*it)->getPragmaInfos();
+			std::for_each(infos.begin(), infos.end(), [&](const PragmaInfo& cur) { builder.addPragma(cur); });
+			continue;
+		}
+
+		const PragmaList& pl = (*it)->getPragmaList();
+		for (auto pit = pl.begin(), pend = pl.end(); pit != pend; ++pit) {
+			builder.addPragma( (*it)->describe(**pit) );
+		}
+	}
+
+	builder.writeTo(out);
+	if (!out) { throw IndexError("unable to write the pragma index"); }
+	return builder.pragmas.size();
+}
+
+bool PragmaIndex::String::operator==(const char* other) const {
+	return std::strlen(other) == size && std::memcmp(data, other, size) == 0;
+}
+
+PragmaIndex::PragmaIndex(const std::string& fileName): mData(NULL), mSize(0), mHeader(NULL) {
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) { throw IndexError("unable to open " + fileName); }
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(index::Header)) {
+		::close(fd);
+		throw IndexError(fileName + " is not a pragma index");
+	}
+
+	void* data = ::mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED) { throw IndexError("unable to map " + fileName); }
+
+	mData = static_cast<const char*>(data);
+	mSize = st.st_size;
+	mHeader = reinterpret_cast<const index::Header*>(mData);
+
+	try {
+		validate();
+	} catch (const IndexError& e) {
+		::munmap(const_cast<char*>(mData), mSize);
+		throw IndexError(fileName + ": " + e.what());
+	}
+}
+
+PragmaIndex::~PragmaIndex() {
+	::munmap(const_cast<char*>(mData), mSize);
+}
+
+void PragmaIndex::validate() const {
+	const index::Header& hdr = *mHeader;
+	if (std::memcmp(hdr.magic, IndexMagic, sizeof(IndexMagic)) != 0) 	{ throw IndexError("not a pragma index"); }
+	if (hdr.version != index::Version) 									{ throw IndexError("unsupported index version"); }
+	if (hdr.byteOrder != index::ByteOrderMark) 							{ throw IndexError("index written with a different byte order"); }
+
+	auto checkTable = [&](uint64_t offset, uint64_t count, size_t entrySize) {
+		if (offset % TableAlignment || offset > mSize || count > (mSize - offset) / entrySize) {
+			throw IndexError("truncated index");
+		}
+	};
+	checkTable(hdr.stringsOffset, hdr.numStrings, sizeof(index::StringEntry));
+	checkTable(hdr.pragmasOffset, hdr.numPragmas, sizeof(index::PragmaEntry));
+	checkTable(hdr.clausesOffset, hdr.numClauses, sizeof(index::ClauseEntry));
+	checkTable(hdr.valuesOffset, hdr.numValues, sizeof(index::ValueEntry));
+	checkTable(hdr.charsOffset, hdr.charsSize, 1);
+
+	// the references among the tables are checked once, accessors can then skip the checks
+	auto strings = reinterpret_cast<const index::StringEntry*>(mData + hdr.stringsOffset);
+	for (uint32_t i = 0; i < hdr.numStrings; ++i) {
+		if (strings[i].offset > hdr.charsSize || strings[i].length > hdr.charsSize - strings[i].offset) {
+			throw IndexError("invalid string table");
+		}
+	}
+	auto pragmas = reinterpret_cast<const index::PragmaEntry*>(mData + hdr.pragmasOffset);
+	for (uint32_t i = 0; i < hdr.numPragmas; ++i) {
+		const index::PragmaEntry& cur = pragmas[i];
+		if (cur.type >= hdr.numStrings || cur.file >= hdr.numStrings ||
+			cur.firstClause > hdr.numClauses || cur.numClauses > hdr.numClauses - cur.firstClause)
+		{
+			throw IndexError("invalid pragma table");
+		}
+	}
+	auto clauses = reinterpret_cast<const index::ClauseEntry*>(mData + hdr.clausesOffset);
+	for (uint32_t i = 0; i < hdr.numClauses; ++i) {
+		const index::ClauseEntry& cur = clauses[i];
+		if (cur.key >= hdr.numStrings || cur.firstValue > hdr.numValues || cur.numValues > hdr.numValues - cur.firstValue) {
+			throw IndexError("invalid clause table");
+		}
+	}
+	auto values = reinterpret_cast<const index::ValueEntry*>(mData + hdr.valuesOffset);
+	for (uint32_t i = 0; i < hdr.numValues; ++i) {
+		if (values[i].str >= hdr.numStrings) { throw IndexError("invalid value table"); }
+	}
+}
+
+PragmaIndex::pragma_iterator PragmaIndex::begin() const {
+	return reinterpret_cast<const index::PragmaEntry*>(mData + mHeader->pragmasOffset);
+}
+
+std::pair<PragmaIndex::clause_iterator, PragmaIndex::clause_iterator>
+PragmaIndex::clauses(const index::PragmaEntry& pragma) const {
+	clause_iterator first = reinterpret_cast<const index::ClauseEntry*>(mData + mHeader->clausesOffset) + pragma.firstClause;
+	return std::make_pair(first, first + pragma.numClauses);
+}
+
+std::pair<PragmaIndex::value_iterator, PragmaIndex::value_iterator>
+PragmaIndex::values(const index::ClauseEntry& clause) const {
+	value_iterator first = reinterpret_cast<const index::ValueEntry*>(mData + mHeader->valuesOffset) + clause.firstValue;
+	return std::make_pair(first, first + clause.numValues);
+}
+
+PragmaIndex::String PragmaIndex::getString(uint32_t idx) const {
+	assert(idx < mHeader->numStrings && "string index out of range");
+	const index::StringEntry& entry = reinterpret_cast<const index::StringEntry*>(mData + mHeader->stringsOffset)[idx];
+	String ret = { mData + mHeader->charsOffset + entry.offset, entry.length };
+	return ret;
+}
+
+} // end clomp namespace
@@ -0,0 +1,316 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#include "driver/prescan.h"
+#include "driver/cache.h"
+
+#include <set>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace clomp;
+
+namespace {
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\f' || c == '\v'; }
+
+inline bool isIdentChar(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// skips blanks and escaped newlines, the position of the first significant character is returned
+const char* skipBlanks(const char* pos, const char* end) {
+	while (pos != end) {
+		if (isBlank(*pos)) 	{ ++pos; continue; }
+		if (*pos == '\\') {
+			const char* next = pos+1;
+			if (next != end && *next == '\r') { ++next; }
+			if (next != end && *next == '\n') { pos = next+1; continue; }
+		}
+		break;
+	}
+	return pos;
+}
+
+// like skipBlanks but newlines are skipped as well
+const char* skipSpaces(const char* pos, const char* end) {
+	for (pos = skipBlanks(pos, end); pos != end && (*pos == '\n' || *pos == '\r'); pos = skipBlanks(pos, end)) {
+		++pos;
+	}
+	return pos;
+}
+
+// reads the identifier starting at pos, an empty string is returned if there is none
+std::string readIdent(const char*& pos, const char* end) {
+	const char* start = pos;
+	while (pos != end && isIdentChar(*pos)) { ++pos; }
+	return std::string(start, pos);
+}
+
+bool startsWithOmp(const char* pos, const char* end) {
+	return end - pos >= 3 && std::memcmp(pos, "omp", 3) == 0 && (end - pos == 3 || !isIdentChar(pos[3]));
+}
+
+/*
+ * Checks whether the '#' at position hash starts a preprocessor directive, i.e. it is
+ * only preceded by blanks on its line. A directive following a block comment on the
+ * same line is accepted as well (the content of the comment is not checked).
+ */
+bool isDirectiveStart(const char* begin, const char* hash) {
+	const char* pos = hash;
+	while (pos != begin && isBlank(pos[-1])) { --pos; }
+	if (pos == begin || pos[-1] == '\n' || pos[-1] == '\r') { return true; }
+	return pos - begin >= 2 && pos[-1] == '/' && pos[-2] == '*';
+}
+
+bool isRegularFile(const std::string& path) {
+	struct stat st;
+	return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/*
+ * Files held in memory shadow the files on disk with the same name, as the 
+ * compiler does for the remapped files
+ */
+const VirtualFile* findVirtual(const std::string& path, const CompilerOptions& options, const VirtualFile* input) {
+	if (input && input->name == path) { return input; }
+	for (auto it = options.virtualFiles.begin(), end = options.virtualFiles.end(); it != end; ++it) {
+		if (it->name == path) { return &*it; }
+	}
+	return NULL;
+}
+
+std::string dirName(const std::string& path) {
+	size_t pos = path.rfind('/');
+	if (pos == std::string::npos) 	{ return "."; }
+	if (pos == 0) 					{ return "/"; }
+	return path.substr(0, pos);
+}
+
+std::string joinPath(const std::string& dir, const std::string& name) {
+	if (dir.empty()) { return name; }
+	return dir[dir.size()-1] == '/' ? dir + name : dir + '/' + name;
+}
+
+/*
+ * Resolves an include directive using the same search order of the compiler, an
+ * empty string is returned if the file is not found within the user and system 
+ * include paths of the options
+ */
+std::string resolveInclude(const PrescanInclude& inc, const std::string& includerDir, 
+						   const CompilerOptions& options, const VirtualFile* input) 
+{
+	auto exists = [&](const std::string& path) { 
+		return findVirtual(path, options, input) || isRegularFile(path); 
+	};
+
+	if (!inc.name.empty() && inc.name[0] == '/') {
+		return exists(inc.name) ? inc.name : std::string();
+	}
+
+	std::vector<const std::vector<std::string>*> searchPaths;
+	if (!inc.angled) {
+		std::string&& path = joinPath(includerDir, inc.name);
+		if (exists(path)) { return path; }
+		searchPaths.push_back(&options.quoteIncludePaths);
+	}
+	searchPaths.push_back(&options.includePaths);
+	searchPaths.push_back(&options.systemIncludePaths);
+
+	for (auto it = searchPaths.begin(), end = searchPaths.end(); it != end; ++it) {
+		for (auto pit = (*it)->begin(), pend = (*it)->end(); pit != pend; ++pit) {
+			std::string&& path = joinPath(*pit, inc.name);
+			if (exists(path)) { return path; }
+		}
+	}
+	return std::string();
+}
+
+bool readFile(const std::string& path, std::string& content) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) { return false; }
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0) { ::close(fd); return false; }
+
+	content.resize(st.st_size);
+	size_t done = 0;
+	while (done < content.size()) {
+		ssize_t ret = ::read(fd, &content[done], content.size() - done);
+		if (ret <= 0) { break; }
+		done += ret;
+	}
+	::close(fd);
+	content.resize(done);
+	return true;
+}
+
+std::string canonicalPath(const std::string& path) {
+	char buf[PATH_MAX];
+	return ::realpath(path.c_str(), buf) ? std::string(buf) : path;
+}
+
+bool scanTranslationUnit(const std::string& fileName, const CompilerOptions& options, 
+						 const VirtualFile* input, std::vector<FileDependency>* scannedFiles) 
+{
+
+	std::set<std::string> visited;
+	std::vector<std::string> worklist(1, fileName);
+	std::vector<FileDependency> scanned;
+	std::string content;
+	std::vector<PrescanInclude> includes;
+
+	while (!worklist.empty()) {
+		std::string path = worklist.back();
+		worklist.pop_back();
+
+		const VirtualFile* virt = findVirtual(path, options, input);
+		if (!visited.insert(virt ? path : canonicalPath(path)).second) { continue; }
+
+		const char *begin, *end;
+		if (virt) {
+			begin = virt->content.data();
+			end = begin + virt->content.size();
+		} else {
+			// let the compiler report unreadable files
+			if (!readFile(path, content)) { return true; }
+			begin = content.data();
+			end = begin + content.size();
+		}
+
+		includes.clear();
+		if (prescanBuffer(begin, end, includes)) { return true; }
+		scanned.push_back( FileDependency(path, hashBuffer(begin, end)) );
+
+		const std::string&& dir = dirName(path);
+		for (auto it = includes.begin(), end = includes.end(); it != end; ++it) {
+			std::string&& resolved = resolveInclude(*it, dir, options, input);
+			if (!resolved.empty()) { 
+				worklist.push_back(resolved); 
+				continue;
+			}
+			// angled includes not found in the given paths are assumed to be headers of the 
+			// default system directories, a quoted one may be found by the compiler in places 
+			// the pre-scan does not search (e.g. the directories of the including files)
+			if (!it->angled) { return true; }
+		}
+	}
+	if (scannedFiles) { scannedFiles->insert(scannedFiles->end(), scanned.begin(), scanned.end()); }
+	return false;
+}
+
+} // end anonymous namespace
+
+namespace clomp {
+
+bool prescanBuffer(const char* begin, const char* end, std::vector<PrescanInclude>& includes) {
+
+	// the search for the interesting characters is done by memchr/memmem which are
+	// vectorized by the C library, only the few hits are then inspected byte by byte
+
+	// _Pragma operators
+	static const char pragmaOp[] = "_Pragma";
+	for (const char* pos = begin; pos != end; ) {
+		const char* hit = static_cast<const char*>(memmem(pos, end-pos, pragmaOp, sizeof(pragmaOp)-1));
+		if (!hit) { break; }
+		pos = hit + sizeof(pragmaOp)-1;
+		if (hit != begin && isIdentChar(hit[-1])) { continue; }
+
+		const char* cur = skipSpaces(pos, end);
+		if (cur == end || *cur != '(') { continue; }
+		if (mayBeOmpPragmaLiteral(skipSpaces(cur+1, end), end)) { return true; }
+	}
+
+	// preprocessor directives
+	for (const char* pos = begin; pos != end; ) {
+		const char* hash = static_cast<const char*>(memchr(pos, '#', end-pos));
+		if (!hash) { break; }
+		pos = hash+1;
+		if (!isDirectiveStart(begin, hash)) { continue; }
+
+		const char* cur = skipBlanks(pos, end);
+		std::string&& directive = readIdent(cur, end);
+		cur = skipBlanks(cur, end);
+
+		if (directive == "pragma") {
+			if (startsWithOmp(cur, end)) { return true; }
+			continue;
+		}
+
+		if (directive != "include" && directive != "include_next" && directive != "import") { continue; }
+
+		if (cur == end) { continue; }
+		char close;
+		if (*cur == '"') 		{ close = '"'; }
+		else if (*cur == '<') 	{ close = '>'; }
+		// the file name is given by a macro: it cannot be followed without preprocessing
+		else { return true; }
+
+		const char* nameEnd = cur+1;
+		while (nameEnd != end && *nameEnd != close && *nameEnd != '\n') { ++nameEnd; }
+		if (nameEnd == end || *nameEnd != close) { continue; }
+
+		includes.push_back( PrescanInclude(std::string(cur+1, nameEnd), close == '>') );
+		pos = nameEnd;
+	}
+	return false;
+}
+
+bool mayBeOmpPragmaLiteral(const char* begin, const char* end) {
+	const char* cur = begin;
+	if (cur != end && *cur == 'L') { ++cur; }
+	// the argument is not a string literal (i.e. it is built by a macro)
+	if (cur == end || *cur != '"') { return true; }
+	return startsWithOmp(skipBlanks(cur+1, end), end);
+}
+
+void findPragmaPoints(const char* begin, const char* end, std::vector<unsigned>& offsets) {
+
+	offsets.clear();
+	static const char pragmaOp[] = "_Pragma";
+	for (const char* pos = begin; pos != end; ) {
+		const char* hit = static_cast<const char*>(memmem(pos, end-pos, pragmaOp, sizeof(pragmaOp)-1));
+		if (!hit) { break; }
+		pos = hit + sizeof(pragmaOp)-1;
+		if (hit == begin || !isIdentChar(hit[-1])) { offsets.push_back(hit - begin); }
+	}
+	size_t numOps = offsets.size();
+
+	for (const char* pos = begin; pos != end; ) {
+		const char* hash = static_cast<const char*>(memchr(pos, '#', end-pos));
+		if (!hash) { break; }
+		pos = hash+1;
+		if (!isDirectiveStart(begin, hash)) { continue; }
+
+		const char* cur = skipBlanks(pos, end);
+		std::string&& directive = readIdent(cur, end);
+		if (directive == "pragma" || directive == "include" || directive == "include_next" || directive == "import") {
+			offsets.push_back(hash - begin);
+		}
+	}
+	// both lists are sorted
+	std::inplace_merge(offsets.begin(), offsets.begin() + numOps, offsets.end());
+}
+
+bool mayContainOmpPragmas(const std::string& fileName, const CompilerOptions& options, 
+						  std::vector<FileDependency>* scannedFiles) 
+{
+	return scanTranslationUnit(fileName, options, NULL, scannedFiles);
+}
+
+bool mayContainOmpPragmas(const VirtualFile& input, const CompilerOptions& options, 
+						  std::vector<FileDependency>* scannedFiles) 
+{
+	return scanTranslationUnit(input.name, options, &input, scannedFiles);
+}
+
+} // end clomp namespace
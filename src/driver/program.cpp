@@ -5,9 +5,12 @@
 // License. See LICENSE.TXT for details.
 //=============================================================================
 #include "driver/program.h"
+#include "driver/prescan.h"
+#include "driver/cache.h"
 
 #include "handler.h"
 #include "omp/pragma.h"
+#include "utils/stats.h"
 
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/ASTConsumer.h"
@@ -21,6 +24,15 @@
 #include "clang/Sema/SemaConsumer.h"
 #include "clang/Sema/ExternalSemaSource.h"
 
+#include "llvm/Support/Threading.h"
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <sstream>
+#include <iterator>
+
 using namespace clomp;
 using namespace clang;
 
@@ -33,12 +45,16 @@ namespace {
 void parseClangAST(ClangCompiler&		comp, 
 				   clang::ASTConsumer*	Consumer, 
 				   bool 				CompleteTranslationUnit, 
-				   PragmaList& 			PL) 
+				   bool 				SkipFunctionBodies, 
+				   PragmaList& 			PL,
+				   PragmaConsumer*		PC = NULL) 
 {
 	ClompSema S(PL, comp.getPreprocessor(), 
 		 		comp.getASTContext(), *Consumer, 
 				CompleteTranslationUnit
 		 	   );
+	if (SkipFunctionBodies) { S.enableBodySkipping(); }
+	S.setPragmaConsumer(PC);
 
 	Parser P(comp.getPreprocessor(), S, false);
 	comp.getPreprocessor().EnterMainSourceFile();
@@ -61,33 +77,216 @@ void parseClangAST(ClangCompiler&		comp,
 		if(ADecl) Consumer->HandleTopLevelDecl(ADecl.getAsVal<DeclGroupRef>());
 
 	Consumer->HandleTranslationUnit(comp.getASTContext());
+	S.flushPendingPragmas();
 	ParserProxy::discard();
 
 	S.dump();
 }
 
+/*
+ * Runs the preprocessor over the input of the compiler, the pragma handlers fill 
+ * the inventory as pragmas are encountered while lexing
+ */
+PragmaInfoList lexPragmas(ClangCompiler& comp, const std::string& file_name) {
+	PragmaInfoList inventory;
+	Preprocessor& PP = comp.getPreprocessor();
+	omp::registerPragmaHandlers(PP);
+
+	PhaseTimer timer(&ParseStats::preprocessTime);
+	PP.EnterMainSourceFile();
+	ParserProxy::init(PP, inventory);
+	Token& tok = ParserProxy::get().CurrentToken();
+	do {
+		PP.Lex(tok);
+	} while (tok.isNot(clang::tok::eof));
+	ParserProxy::discard();
+
+	if( comp.getDiagnostics().hasErrorOccurred() ) {
+		throw ClangParsingError(file_name);
+	}
+	return inventory;
+}
+
 } // end anonymous namespace
 
 namespace clomp {
 
-TranslationUnit::TranslationUnit(const std::string& file_name): 
-	mFileName(file_name), mClang(file_name)  
+TranslationUnit::TranslationUnit(const std::string& file_name, const CompilerOptions& options): 
+	mFileName(file_name), mCached(false)
+{
+	init(NULL, options, NULL);
+}
+
+TranslationUnit::TranslationUnit(const std::string& file_name, PragmaConsumer& consumer, const CompilerOptions& options): 
+	mFileName(file_name), mCached(false)
 {
+	init(NULL, options, &consumer);
+}
+
+TranslationUnit::TranslationUnit(const VirtualFile& input, const CompilerOptions& options): 
+	mFileName(input.name), mCached(false)
+{
+	init(&input, options, NULL);
+}
+
+TranslationUnit::~TranslationUnit() { }
+
+void TranslationUnit::init(const VirtualFile* input, const CompilerOptions& options, PragmaConsumer* consumer) {
+	// only the pragmas of a detached translation unit (i.e. the PragmaInfo list) can be cached, 
+	// statistics are never taken from the cache
+	std::string cacheKey;
+	if (options.cache && options.detach && !input && !consumer && !options.collectStats && !options.collectMemory) {
+		cacheKey = ResultCache::makeKey("pragma-infos", mFileName, options);
+		if (loadFromCache(*options.cache, cacheKey)) { return; }
+	}
+
+	StatsScope stats(options.collectStats ? &mStats : NULL);
+
+	// the peak is process-wide, it is left to the owner of the process to reset it
+	MemoryUsage before = { 0, 0 };
+	if (options.collectMemory) { before = MemoryUsage::current(); }
+
+	// the pragma list of a translation unit without OpenMP pragmas is empty, neither
+	// the compiler nor the parser are needed and the translation unit stays detached
+	bool mayContainPragmas = true;
+	if (options.prescan) {
+		PhaseTimer timer(&ParseStats::prescanTime);
+		mayContainPragmas = input ? mayContainOmpPragmas(*input, options, &mDependencies) 
+								  : mayContainOmpPragmas(mFileName, options, &mDependencies);
+	}
+	if (mayContainPragmas) { 
+		{
+			PhaseTimer timer(&ParseStats::setupTime);
+			mClang.reset( input ? new ClangCompiler(*input, options) : new ClangCompiler(mFileName, options) );
+		}
+		PhaseTimer timer(&ParseStats::parseTime);
+		parse(options, consumer); 
+	}
+	if (options.collectMemory && mClang) { measureMemory(); }
+	if (options.detach) { detach(); }
+	if (!cacheKey.empty()) { storeToCache(*options.cache, cacheKey, options); }
+
+	if (options.collectMemory) {
+		MemoryUsage after = MemoryUsage::current();
+		mMemory.peakRSSDelta = static_cast<long>(after.peakRSS) - static_cast<long>(before.rss);
+		mMemory.retainedRSSDelta = static_cast<long>(after.rss) - static_cast<long>(before.rss);
+	}
+}
+
+void TranslationUnit::measureMemory() {
+	clang::ASTContext& ctx = mClang->getASTContext();
+	mMemory.astBytes = ctx.getASTAllocatedMemory() + ctx.getSideTableAllocatedMemory();
+
+	mMemory.pragmaBytes = mPragmaList.capacity() * sizeof(PragmaPtr);
+	mMemory.matchBytes = 0;
+	std::for_each(mPragmaList.begin(), mPragmaList.end(), [&](const PragmaPtr& cur) {
+		const omp::OmpPragma* ompPragma = dynamic_cast<const omp::OmpPragma*>(cur.get());
+		mMemory.pragmaBytes += (ompPragma ? sizeof(omp::OmpPragma) : sizeof(Pragma)) + allocatedSize(cur->getType());
+		if (ompPragma) { mMemory.matchBytes += ompPragma->getMap().getAllocatedSize(); }
+	});
+}
+
+void TranslationUnit::parse(const CompilerOptions& options, PragmaConsumer* consumer) {
 	// register 'omp' pragmas
-	omp::registerPragmaHandlers( mClang.getPreprocessor() );
+	omp::registerPragmaHandlers( mClang->getPreprocessor() );
 
 	clang::ASTConsumer emptyCons;
-	parseClangAST(mClang, &emptyCons, true, mPragmaList);
+	parseClangAST(*mClang, &emptyCons, true, options.skipFunctionBodies, mPragmaList, consumer);
 
-	if( mClang.getDiagnostics().hasErrorOccurred() ) {
+	if( mClang->getDiagnostics().hasErrorOccurred() ) {
 		// errors are always fatal!
-		throw ClangParsingError(file_name);
+		throw ClangParsingError(mFileName);
 	}
+	mDependencies = mClang->getDependencies();
+}
+
+bool TranslationUnit::loadFromCache(const ResultCache& cache, const std::string& key) {
+	std::string record;
+	std::vector<FileDependency> deps;
+	if (!cache.lookup(key, record, &deps)) { return false; }
 
+	std::istringstream in(record);
+	size_t numPragmas;
+	if (!(in >> numPragmas)) { return false; }
+
+	PragmaInfoList infos;
+	infos.reserve(numPragmas);
+	for (size_t i = 0; i < numPragmas; ++i) {
+		if (!PragmaInfo::readFrom(in, infos)) { return false; }
+	}
+	mPragmaInfos.swap(infos);
+	mDependencies.swap(deps);
+	mCached = true;
+	return true;
+}
+
+void TranslationUnit::storeToCache(const ResultCache& cache, const std::string& key, const CompilerOptions& options) const {
+	std::ostringstream ss;
+	ss << mPragmaInfos.size() << "\n";
+	std::for_each(mPragmaInfos.begin(), mPragmaInfos.end(), [&](const PragmaInfo& cur) { cur.writeTo(ss); });
+
+	// the content of the virtual files is part of the key, they are not on disk to be checked
+	std::vector<FileDependency> deps;
+	std::copy_if(mDependencies.begin(), mDependencies.end(), std::back_inserter(deps), [&](const FileDependency& dep) {
+		return std::find_if(options.virtualFiles.begin(), options.virtualFiles.end(), 
+							[&](const VirtualFile& cur) { return cur.name == dep.name; }) == options.virtualFiles.end();
+	});
+	cache.store(key, deps, ss.str());
+}
+
+PragmaInfo TranslationUnit::describe(const Pragma& pragma) const {
+	assert(mClang && "Pragmas of a detached translation unit cannot be described");
+	// only OpenMP pragmas keep the values matched by the pragma matcher
+	const omp::OmpPragma* ompPragma = dynamic_cast<const omp::OmpPragma*>(&pragma);
+	static const MatchMap noValues;
+	return PragmaInfo(pragma, ompPragma ? ompPragma->getMap() : noValues, 
+					  mClang->getSourceManager(), mClang->getPreprocessor().getLangOpts());
+}
+
+void TranslationUnit::detach() {
+	if (!mClang) { return; }
+
+	mPragmaInfos.reserve(mPragmaList.size());
+	std::for_each(mPragmaList.begin(), mPragmaList.end(), [&](const PragmaPtr& cur) {
+		mPragmaInfos.push_back( describe(*cur) );
+	});
+	// the pragmas refer to the AST, they have to be released before the compiler
+	PragmaList().swap(mPragmaList);
+	mClang.reset();
+}
+
+PragmaInfoList collectPragmas(const std::string& file_name, const CompilerOptions& options, 
+							  std::vector<FileDependency>* dependencies) 
+{
+	if (options.prescan) {
+		PhaseTimer timer(&ParseStats::prescanTime);
+		if (!mayContainOmpPragmas(file_name, options, dependencies)) { return PragmaInfoList(); }
+	}
+
+	std::unique_ptr<ClangCompiler> comp;
+	{
+		PhaseTimer timer(&ParseStats::setupTime);
+		comp.reset( new ClangCompiler(file_name, options) );
+	}
+	PragmaInfoList&& inventory = lexPragmas(*comp, file_name);
+	if (dependencies) { 
+		std::vector<FileDependency>&& files = comp->getDependencies();
+		dependencies->insert(dependencies->end(), files.begin(), files.end());
+	}
+	return inventory;
+}
+
+PragmaInfoList collectPragmas(const VirtualFile& input, const CompilerOptions& options) {
+	if (options.prescan && !mayContainOmpPragmas(input, options)) { return PragmaInfoList(); }
+
+	ClangCompiler comp(input, options);
+	return lexPragmas(comp, input.name);
 }
 
 struct Program::ProgramImpl {
 	TranslationUnitSet tranUnits;
+	// guards tranUnits when translation units are added concurrently
+	std::mutex tranUnitsMutex;
 
 	ProgramImpl() { }
 };
@@ -95,13 +294,69 @@ struct Program::ProgramImpl {
 Program::Program(): pimpl( new ProgramImpl() ) { }
 Program::~Program() { delete pimpl; }
 
-TranslationUnit& Program::addTranslationUnit(const std::string& file_name) {
-	auto tu = std::make_shared<TranslationUnit>(file_name);
+TranslationUnit& Program::addTranslationUnit(const std::string& file_name, const CompilerOptions& options) {
+	auto tu = std::make_shared<TranslationUnit>(file_name, options);
 	/* the shared_ptr will take care of cleaning the memory */;
+	std::lock_guard<std::mutex> lock(pimpl->tranUnitsMutex);
+	pimpl->tranUnits.insert( tu );
+	return *tu;
+}
+
+TranslationUnit& Program::addTranslationUnit(const VirtualFile& input, const CompilerOptions& options) {
+	auto tu = std::make_shared<TranslationUnit>(input, options);
+	std::lock_guard<std::mutex> lock(pimpl->tranUnitsMutex);
 	pimpl->tranUnits.insert( tu );
 	return *tu;
 }
 
+std::vector<TranslationUnitPtr> 
+Program::addTranslationUnits(const std::vector<std::string>& file_names, const CompilerOptions& options, unsigned threads) {
+
+	std::vector<TranslationUnitPtr> tus(file_names.size());
+	if (file_names.empty()) { return tus; }
+
+	if (threads == 0) {
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	threads = std::min<unsigned>(threads, file_names.size());
+
+	// LLVM needs to be told that it is going to be used by multiple threads
+	if (threads > 1) { llvm::llvm_start_multithreaded(); }
+
+	std::atomic<size_t> next(0);
+	std::exception_ptr firstError;
+	std::mutex errorMutex;
+
+	// each worker picks the next file to be parsed until the list is exhausted
+	auto worker = [&] () {
+		for (size_t idx = next++; idx < file_names.size(); idx = next++) {
+			try {
+				tus[idx] = std::make_shared<TranslationUnit>(file_names[idx], options);
+			} catch(...) {
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (!firstError) { firstError = std::current_exception(); }
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 1; i < threads; ++i) {
+		pool.push_back( std::thread(worker) );
+	}
+	worker();
+	std::for_each(pool.begin(), pool.end(), [](std::thread& cur) { cur.join(); });
+
+	{
+		std::lock_guard<std::mutex> lock(pimpl->tranUnitsMutex);
+		std::for_each(tus.begin(), tus.end(), [&](const TranslationUnitPtr& tu) {
+			if (tu) { pimpl->tranUnits.insert(tu); }
+		});
+	}
+
+	if (firstError) { std::rethrow_exception(firstError); }
+	return tus;
+}
+
 const Program::TranslationUnitSet& Program::getTranslationUnits() const { 
 	return pimpl->tranUnits; 
 }
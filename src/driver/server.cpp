@@ -0,0 +1,212 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#include "driver/server.h"
+#include "driver/program.h"
+#include "driver/batch.h"
+#include "handler.h"
+
+#include "llvm/Support/Threading.h"
+
+#include <sstream>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+using namespace clomp;
+
+namespace {
+
+bool writeAll(int fd, const char* data, size_t size) {
+	while (size) {
+		ssize_t ret = ::write(fd, data, size);
+		if (ret < 0 && errno == EINTR) { continue; }
+		if (ret <= 0) { return false; }
+		data += ret;
+		size -= ret;
+	}
+	return true;
+}
+
+bool sendResponse(int fd, bool success, const std::string& payload) {
+	std::ostringstream ss;
+	ss << (success ? "OK " : "ERR ") << payload.size() << "\n";
+	const std::string& hdr = ss.str();
+	return writeAll(fd, hdr.data(), hdr.size()) && writeAll(fd, payload.data(), payload.size());
+}
+
+std::string systemError(const std::string& msg) {
+	return msg + ": " + strerror(errno);
+}
+
+} // end anonymous namespace
+
+namespace clomp {
+
+Server::Server(const std::string& socketPath, const OptionsMap& options, const CompilerOptions& defaultOptions) : 
+	mSocketPath(socketPath), mOptions(options), mDefaultOptions(defaultOptions), mListenFd(-1), mQuit(false) 
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(addr.sun_path)) {
+		throw ServerError("socket path too long: " + socketPath);
+	}
+	strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path)-1);
+
+	mListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (mListenFd < 0) { throw ServerError(systemError("unable to create socket")); }
+
+	// a socket left behind by a previous instance is removed, unless that instance is still
+	// serving requests. Any other kind of file (e.g. a mistyped source file) is never removed
+	struct stat st;
+	if (lstat(socketPath.c_str(), &st) == 0) {
+		std::string err;
+		if (!S_ISSOCK(st.st_mode)) {
+			err = socketPath + " exists and is not a socket";
+		} else {
+			int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+				err = "a server is already listening on " + socketPath;
+			}
+			if (probe >= 0) { close(probe); }
+		}
+		if (!err.empty()) {
+			close(mListenFd);
+			throw ServerError(err);
+		}
+		unlink(socketPath.c_str());
+	}
+
+	if (bind(mListenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(mListenFd, 16) != 0) {
+		std::string&& err = systemError("unable to listen on " + socketPath);
+		close(mListenFd);
+		throw ServerError(err);
+	}
+}
+
+Server::~Server() {
+	if (mListenFd >= 0) { close(mListenFd); }
+	unlink(mSocketPath.c_str());
+}
+
+bool Server::handleParse(int fd, bool inventory, const std::string& file, const VirtualFile* input) {
+	auto fit = mOptions.find(file);
+	const CompilerOptions& options = fit != mOptions.end() ? fit->second : mDefaultOptions;
+	std::ostringstream ss;
+	try {
+		if (inventory) {
+			printInventory(ss, input ? collectPragmas(*input, options) : collectPragmas(file, options));
+		} else {
+			Program p;
+			printPragmas(ss, input ? p.addTranslationUnit(*input, options) : p.addTranslationUnit(file, options));
+		}
+	} catch (const std::exception& e) {
+		return sendResponse(fd, false, std::string("unable to parse translation unit: ") + e.what());
+	}
+	return sendResponse(fd, true, ss.str());
+}
+
+void Server::serveClient(int fd) {
+	std::string buffer;
+	char chunk[4096];
+
+	// appends the next bytes sent by the client to the buffer, false when the connection is closed
+	auto readMore = [&]() -> bool {
+		while (true) {
+			ssize_t n = ::read(fd, chunk, sizeof(chunk));
+			if (n < 0 && errno == EINTR) { continue; }
+			if (n <= 0) { return false; }
+			buffer.append(chunk, n);
+			return true;
+		}
+	};
+
+	while (!mQuit) {
+		size_t eol = buffer.find('\n');
+		if (eol == std::string::npos) {
+			if (!readMore()) { break; }
+			continue;
+		}
+
+		std::string request = buffer.substr(0, eol);
+		buffer.erase(0, eol+1);
+		if (!request.empty() && request[request.size()-1] == '\r') { request.erase(request.size()-1); }
+
+		bool ok = true;
+		if (request == "PING") {
+			ok = sendResponse(fd, true, std::string());
+		} else if (request == "QUIT") {
+			mQuit = true;
+			sendResponse(fd, true, std::string());
+			// wakes up the thread blocked in accept()
+			shutdown(mListenFd, SHUT_RDWR);
+		} else if (request.compare(0, 6, "PARSE ") == 0 || request.compare(0, 10, "INVENTORY ") == 0) {
+			bool inventory = request[0] == 'I';
+			ok = handleParse(fd, inventory, request.substr(inventory ? 10 : 6), NULL);
+		} else if (request.compare(0, 13, "PARSE_BUFFER ") == 0 || request.compare(0, 17, "INVENTORY_BUFFER ") == 0) {
+			bool inventory = request[0] == 'I';
+			std::istringstream args(request.substr(inventory ? 17 : 13));
+			size_t length;
+			std::string file;
+			if (!(args >> length) || args.get() != ' ' || !std::getline(args, file) || file.empty()) {
+				// the content cannot be told apart from the next request, the connection is closed
+				sendResponse(fd, false, "malformed request: " + request);
+				break;
+			}
+			while (buffer.size() < length && readMore()) { }
+			if (buffer.size() < length) { break; }
+
+			VirtualFile input(file, buffer.substr(0, length));
+			buffer.erase(0, length);
+			ok = handleParse(fd, inventory, file, &input);
+		} else {
+			ok = sendResponse(fd, false, "unknown request: " + request);
+		}
+		if (!ok) { break; }
+	}
+
+	std::lock_guard<std::mutex> lock(mClientsMutex);
+	mClients.erase(fd);
+	close(fd);
+	mClientsDone.notify_all();
+}
+
+void Server::run() {
+	// clients are served by concurrent threads
+	llvm::llvm_start_multithreaded();
+	// a client closing the connection before reading the response must not kill the server
+	signal(SIGPIPE, SIG_IGN);
+
+	while (!mQuit) {
+		int fd = accept(mListenFd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) { continue; }
+			break;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mClientsMutex);
+			mClients.insert(fd);
+		}
+		std::thread(&Server::serveClient, this, fd).detach();
+	}
+
+	// disconnect the clients which are still connected and wait for their threads
+	std::unique_lock<std::mutex> lock(mClientsMutex);
+	for (auto it = mClients.begin(), end = mClients.end(); it != end; ++it) {
+		shutdown(*it, SHUT_RDWR);
+	}
+	mClientsDone.wait(lock, [&]() { return mClients.empty(); });
+}
+
+} // end clomp namespace
@@ -6,10 +6,14 @@
 //=============================================================================
 #include "handler.h"
 #include "utils/source_locations.h"
+#include "utils/string_utils.h"
 
 #include "clang/AST/Stmt.h"
 #include <llvm/Support/raw_ostream.h>
 #include <clang/AST/Expr.h>
+#include <clang/AST/Decl.h>
+#include <clang/Lex/Lexer.h>
+#include <clang/Basic/SourceManager.h>
 
 using namespace clang;
 using namespace clomp;
@@ -26,6 +30,11 @@ void Pragma::setDecl(clang::Decl const* decl) {
 	mTargetNode = decl;
 }
 
+void Pragma::setPositions(const clang::SourceManager& sm) {
+	mStartPos = sm.getDecomposedExpansionLoc(mStartLoc);
+	mEndPos = sm.getDecomposedExpansionLoc(mEndLoc);
+}
+
 clang::Stmt const* Pragma::getStatement() const {
 	assert(!mTargetNode.isNull() && isStatement());
 	return mTargetNode.get<clang::Stmt const*> ();
@@ -60,4 +69,154 @@ void Pragma::dump(std::ostream& out, const clang::SourceManager& sm) const {
 		   "|~> Pragma: " << getType() << " -> " << std::flush << toStr(sm) << "\n";
 }
 
+namespace {
+
+unsigned fileOffset(const clang::SourceLocation& loc, const clang::SourceManager& sm) {
+	return loc.isValid() ? sm.getFileOffset(sm.getExpansionLoc(loc)) : 0;
+}
+
+// strings are written as <size>:<characters>, so they can contain any character
+void writeString(std::ostream& out, const std::string& str) {
+	out << str.size() << ':' << str;
+}
+
+bool readString(std::istream& in, std::string& str) {
+	size_t size;
+	if (!(in >> size) || in.get() != ':') { return false; }
+	str.resize(size);
+	return size == 0 || in.read(&str[0], size);
+}
+
+} // end anonymous namespace
+
+PragmaInfo::PragmaInfo(const std::string& 			type, 
+					   const clang::SourceLocation& startLoc, 
+					   const clang::SourceLocation& endLoc, 
+					   const clang::SourceManager& 	sm, 
+					   const MatchMap& 				mmap) :
+	mType(type), mFileName(utils::FileName(startLoc, sm)), 
+	mLine(utils::Line(startLoc, sm)), mColumn(utils::Column(startLoc, sm)),
+	mStartOffset(fileOffset(startLoc, sm)), mEndOffset(fileOffset(endLoc, sm)),
+	mTargetKind(TARGET_NONE), mTargetStart(0), mTargetEnd(0)
+{
+	std::for_each(mmap.begin(), mmap.end(), [&](const MatchMap::value_type& cur) {
+		const std::string& key = MatchMap::getKeyName(cur.first);
+		std::vector<std::string>& values = mClauses[key];
+		std::for_each(cur.second.begin(), cur.second.end(), [&](const ValueUnion& value) {
+			values.push_back( value.toStr() );
+		});
+		mValueKinds[key].resize(values.size(), VALUE_SPELLING);
+	});
+}
+
+PragmaInfo::PragmaInfo(const Pragma& 				pragma, 
+					   const MatchMap& 				mmap,
+					   const clang::SourceManager& 	sm, 
+					   const clang::LangOptions& 	LO) :
+	mType(pragma.getType()), mFileName(utils::FileName(pragma.getStartLocation(), sm)), 
+	mLine(utils::Line(pragma.getStartLocation(), sm)), mColumn(utils::Column(pragma.getStartLocation(), sm)),
+	mStartOffset(fileOffset(pragma.getStartLocation(), sm)), mEndOffset(fileOffset(pragma.getEndLocation(), sm)),
+	mTargetKind(TARGET_NONE), mTargetStart(0), mTargetEnd(0)
+{
+	SourceRange target;
+	if (pragma.isStatement()) {
+		mTargetKind = TARGET_STMT;
+		target = pragma.getStatement()->getSourceRange();
+	} else if (pragma.isDecl()) {
+		mTargetKind = TARGET_DECL;
+		target = pragma.getDecl()->getSourceRange();
+	}
+	mTargetStart = fileOffset(target.getBegin(), sm);
+	mTargetEnd = fileOffset(target.getEnd(), sm);
+
+	std::for_each(mmap.begin(), mmap.end(), [&](const MatchMap::value_type& cur) {
+		const std::string& key = MatchMap::getKeyName(cur.first);
+		std::vector<std::string>& values = mClauses[key];
+		std::vector<ValueKind>& kinds = mValueKinds[key];
+
+		std::for_each(cur.second.begin(), cur.second.end(), [&](const ValueUnion& value) {
+			if (value.isString()) {
+				values.push_back( value.getString().str() );
+				kinds.push_back( VALUE_SPELLING );
+				return;
+			}
+			const Stmt* stmt = value.getStmt();
+			if (const DeclRefExpr* ref = dyn_cast_or_null<DeclRefExpr>(stmt)) {
+				values.push_back( ref->getDecl()->getNameAsString() );
+				kinds.push_back( VALUE_VARIABLE );
+				return;
+			}
+			// the expression as it is spelled in the source, the pretty printed
+			// expression is used when the source range is not available
+			StringRef spelling;
+			if (stmt && stmt->getSourceRange().isValid()) {
+				spelling = Lexer::getSourceText(CharSourceRange::getTokenRange(stmt->getSourceRange()), sm, LO);
+			}
+			values.push_back( spelling.empty() ? value.toStr() : spelling.str() );
+			kinds.push_back( VALUE_EXPRESSION );
+		});
+	});
+}
+
+void PragmaInfo::writeTo(std::ostream& out) const {
+	writeString(out, mType);
+	out << ' ';
+	writeString(out, mFileName);
+	out << ' ' << mLine << ' ' << mColumn << ' ' << mStartOffset << ' ' << mEndOffset << ' ' 
+		<< mTargetKind << ' ' << mTargetStart << ' ' << mTargetEnd << ' ' << mClauses.size() << ' ';
+
+	std::for_each(mClauses.begin(), mClauses.end(), [&](const ClauseMap::value_type& cur) {
+		const std::vector<ValueKind>& kinds = mValueKinds.find(cur.first)->second;
+		assert(kinds.size() == cur.second.size());
+		writeString(out, cur.first);
+		out << ' ' << cur.second.size() << ' ';
+		for (size_t i = 0; i < cur.second.size(); ++i) {
+			out << kinds[i] << ' ';
+			writeString(out, cur.second[i]);
+		}
+	});
+	out << '\n';
+}
+
+bool PragmaInfo::readFrom(std::istream& in, PragmaInfoList& list) {
+	PragmaInfo info;
+	unsigned targetKind;
+	size_t numClauses;
+	if (!readString(in, info.mType) || !readString(in, info.mFileName) || 
+		!(in >> info.mLine >> info.mColumn >> info.mStartOffset >> info.mEndOffset 
+			 >> targetKind >> info.mTargetStart >> info.mTargetEnd >> numClauses) || 
+		targetKind > TARGET_DECL) 
+	{
+		return false;
+	}
+	info.mTargetKind = static_cast<TargetKind>(targetKind);
+
+	for (size_t i = 0; i < numClauses; ++i) {
+		std::string key;
+		size_t numValues;
+		if (!readString(in, key) || !(in >> numValues)) { return false; }
+
+		std::vector<std::string>& values = info.mClauses[key];
+		std::vector<ValueKind>& kinds = info.mValueKinds[key];
+		for (size_t j = 0; j < numValues; ++j) {
+			unsigned kind;
+			std::string value;
+			if (!(in >> kind) || kind > VALUE_EXPRESSION || !readString(in, value)) { return false; }
+			kinds.push_back( static_cast<ValueKind>(kind) );
+			values.push_back( value );
+		}
+	}
+	list.push_back( info );
+	return true;
+}
+
+std::ostream& PragmaInfo::printTo(std::ostream& out) const {
+	out << mFileName << ":" << mLine << ":" << mColumn << ": " << mType;
+	std::for_each(mClauses.begin(), mClauses.end(), [&](const ClauseMap::value_type& cur) {
+		out << " " << cur.first;
+		if (!cur.second.empty()) { out << "(" << utils::join(cur.second, ", ") << ")"; }
+	});
+	return out;
+}
+
 } // End clomp namespace
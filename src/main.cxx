@@ -8,8 +8,16 @@
 #include "handler.h"
 #include "omp/pragma.h"
 #include "omp/annotation.h"
+#include "driver/batch.h"
+#include "driver/compilation_db.h"
+#include "driver/server.h"
+#include "driver/cache.h"
+#include "driver/index.h"
 
 #include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
 
 using namespace clomp;
 
@@ -26,26 +34,174 @@ Developed by:   Simone Pellegrini \n\
                 http://www.dps.uibk.ac.at/en/index.html \n\
 ========================================================\n";
 
+void usage(const char* prog) {
+	std::cerr << "usage: " << prog << " [-j <jobs>] <file> [<file> ...]" << std::endl
+			  << "       " << prog << " [-j <jobs>] --compdb <compile_commands.json>" << std::endl
+			  << "       " << prog << " --serve <socket> [--compdb <compile_commands.json>]" << std::endl
+			  << std::endl
+			  << "  -j, --jobs <n>   process the files using <n> worker processes" << std::endl
+			  << "  --compdb <file>  process every entry of a compilation database" << std::endl
+			  << "  --serve <path>   serve parse requests on a Unix socket" << std::endl
+			  << "  --inventory      only list the pragmas and their clauses, no AST is built" << std::endl
+			  << "  --index <file>   write the pragmas of all the files to a binary index" << std::endl
+			  << "  --cache <dir>    reuse the results of the files (and headers) which did not change" << std::endl
+			  << "  --stats          report the time spent in each phase and the parser counters" << std::endl
+			  << "  --mem            report the memory used by each translation unit (ignored by --inventory)" << std::endl
+			  << "  --no-prescan     parse every file, even those without OpenMP pragmas" << std::endl
+			  << "  --no-skip-bodies parse every function body, even those without pragmas" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
 
-	std::cout << license << std::endl;
+	unsigned jobs = 0;
+	bool prescan = true, skipBodies = true, inventory = false, stats = false, mem = false;
+	std::string compdb, socket, cacheDir, indexFile;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg(argv[i]);
+		if ((arg == "-j" || arg == "--jobs") && i+1 < argc) {
+			jobs = std::max(atoi(argv[++i]), 1);
+		} else if (arg == "--compdb" && i+1 < argc) {
+			compdb = argv[++i];
+		} else if (arg == "--serve" && i+1 < argc) {
+			socket = argv[++i];
+		} else if (arg == "--index" && i+1 < argc) {
+			indexFile = argv[++i];
+		} else if (arg == "--cache" && i+1 < argc) {
+			cacheDir = argv[++i];
+		} else if (arg == "--mem") {
+			mem = true;
+		} else if (arg == "--stats") {
+			stats = true;
+		} else if (arg == "--inventory") {
+			inventory = true;
+		} else if (arg == "--no-prescan") {
+			prescan = false;
+		} else if (arg == "--no-skip-bodies") {
+			skipBodies = false;
+		} else if (!arg.empty() && arg[0] == '-') {
+			usage(argv[0]);
+			return 1;
+		} else {
+			files.push_back(arg);
+		}
+	}
 
-	Program p;
-	TranslationUnit& tu = p.addTranslationUnit(argv[1]);
+	if (files.empty() && compdb.empty() && socket.empty()) {
+		usage(argv[0]);
+		return 1;
+	}
 
-	int c=0;
-	for(auto it = p.pragmas_begin(), end = p.pragmas_end(); it != end; ++it) {
-//		std::cout << "Pragma" << std::endl;
-//
-		PragmaPtr pragma = (*it).first;
-		if (std::shared_ptr<omp::OmpPragma> omp_pragma = 
-				std::dynamic_pointer_cast<omp::OmpPragma>(pragma)) 
-		{
-			std::cout << "OmpPragma: " << *omp_pragma->toAnnotation() << std::endl;
-			c++;
+	// the driver only reports pragmas, files and function bodies without pragmas need not be parsed
+	CompilerOptions defaultOptions;
+	defaultOptions.prescan = prescan;
+	defaultOptions.skipFunctionBodies = skipBodies;
+	defaultOptions.collectStats = stats;
+	defaultOptions.collectMemory = mem;
+
+	std::vector<BatchEntry> entries;
+	std::for_each(files.begin(), files.end(), [&](const std::string& cur) { 
+		entries.push_back( BatchEntry(cur, defaultOptions) ); 
+	});
+
+	if (!compdb.empty()) {
+		try {
+			CompileCommandList&& cmds = loadCompilationDatabase(compdb);
+			std::for_each(cmds.begin(), cmds.end(), [&](const CompileCommand& cur) {
+				CompilerOptions&& opts = cur.getCompilerOptions();
+				opts.prescan = prescan;
+				opts.skipFunctionBodies = skipBodies;
+				opts.collectStats = stats;
+				opts.collectMemory = mem;
+				entries.push_back( BatchEntry(cur.getFilePath(), opts) );
+			});
+		} catch (const CompilationDatabaseError& e) {
+			std::cerr << "error: " << e.what() << std::endl;
+			return 1;
 		}
 	}
-	
-	std::cout << c << " OpenMP pragmas" << std::endl;
 
+	// server mode: the entries of the compilation database provide the options for the requests
+	if (!socket.empty()) {
+		Server::OptionsMap options;
+		std::for_each(entries.begin(), entries.end(), [&](const BatchEntry& cur) {
+			options[cur.file] = cur.options;
+		});
+		try {
+			Server server(socket, options, defaultOptions);
+			server.run();
+		} catch (const ServerError& e) {
+			std::cerr << "error: " << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	// index mode: the translation units are all kept by a single program, their pragmas 
+	// are written once all the files are parsed. The translation units are detached so 
+	// that only the AST of the file being parsed is kept in memory.
+	if (!indexFile.empty()) {
+		Program p;
+		unsigned failed = 0;
+		std::for_each(entries.begin(), entries.end(), [&](BatchEntry& cur) {
+			try {
+				cur.options.detach = true;
+				p.addTranslationUnit(cur.file, cur.options);
+			} catch (const std::exception& e) {
+				std::cerr << "error: unable to parse translation unit: " << e.what() << std::endl;
+				++failed;
+			}
+		});
+		try {
+			std::ofstream out(indexFile.c_str(), std::ios::binary);
+			unsigned num = writePragmaIndex(out, p);
+			std::cout << num << " pragmas written to " << indexFile << std::endl;
+		} catch (const IndexError& e) {
+			std::cerr << "error: " << e.what() << std::endl;
+			return 1;
+		}
+		return failed ? 1 : 0;
+	}
+
+	// batch mode: all the files are processed by this process (or by a pool of 
+	// worker processes) and the output is buffered
+	if (jobs || !compdb.empty() || !cacheDir.empty() || files.size() > 1) {
+		std::ios::sync_with_stdio(false);
+
+		BatchDriver driver(entries, jobs, inventory);
+		if (!cacheDir.empty()) {
+			try {
+				driver.setCache( std::make_shared<ResultCache>(cacheDir) );
+			} catch (const CacheError& e) {
+				std::cerr << "error: " << e.what() << std::endl;
+				return 1;
+			}
+		}
+		return driver.run(std::cout) ? 1 : 0;
+	}
+
+	std::cout << license << std::endl;
+	std::cout << files.front() << std::endl;
+
+	if (inventory) {
+		try {
+			ParseStats inventoryStats;
+			StatsScope scope(stats ? &inventoryStats : NULL);
+			printInventory(std::cout, collectPragmas(files.front(), defaultOptions));
+			if (stats) { inventoryStats.printTo(std::cout << "stats: ") << std::endl; }
+		} catch (const ClangParsingError& e) {
+			std::cerr << "error: unable to preprocess " << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	// the peak reached while starting up is not part of the translation unit
+	if (mem) { MemoryUsage::resetPeak(); }
+
+	Program p;
+	TranslationUnit& tu = p.addTranslationUnit(files.front(), defaultOptions);
+	printPragmas(std::cout, tu);
+	if (stats) { tu.getStats().printTo(std::cout << "stats: ") << std::endl; }
+	if (mem) { tu.getMemoryStats().printTo(std::cout << "memory: ") << std::endl; }
 }
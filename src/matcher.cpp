@@ -7,6 +7,7 @@
 #include "matcher.h"
 #include "utils/source_locations.h"
 #include "utils/string_utils.h"
+#include "utils/stats.h"
 
 #include <clang/Lex/Preprocessor.h>
 #include <clang/Parse/Parser.h>
@@ -18,11 +19,13 @@
 #include <clang/Basic/Diagnostic.h>
 
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/ADT/StringMap.h>
 
 using namespace clang;
 using namespace clomp;
 
 #include <sstream>
+#include <deque>
 
 namespace {
 
@@ -39,28 +42,65 @@ void reportRecord( std::ostream& 					ss,
 	ss << std::endl;
 }
 
+/*
+ * In lexer mode an expression is matched as the sequence of tokens up to the first
+ * unbalanced closing bracket, the first ':' which does not belong to a conditional
+ * operator, or the end of the directive. The spelling of the tokens is stored.
+ */
+bool matchExprTokens(clang::Preprocessor& PP, std::string& spelling) {
+	unsigned depth = 0, conditionals = 0;
+	std::ostringstream ss;
+	for (bool first = true; ; first = false) {
+		const clang::Token& next = PP.LookAhead(0);
+		if (next.is(clang::tok::eod) || next.is(clang::tok::eof)) { break; }
+
+		if (next.is(clang::tok::l_paren) || next.is(clang::tok::l_square) || next.is(clang::tok::l_brace)) { 
+			++depth; 
+		} else if (next.is(clang::tok::r_paren) || next.is(clang::tok::r_square) || next.is(clang::tok::r_brace)) {
+			if (depth == 0) { break; }
+			--depth;
+		} else if (depth == 0 && next.is(clang::tok::question)) {
+			++conditionals;
+		} else if (depth == 0 && next.is(clang::tok::colon)) {
+			if (conditionals == 0) { break; }
+			--conditionals;
+		}
+
+		clang::Token& tok = ParserProxy::get().ConsumeToken();
+		if (!first && tok.hasLeadingSpace()) { ss << " "; }
+		ss << PP.getSpelling(tok);
+	}
+	spelling = ss.str();
+	return !spelling.empty();
+}
+
+/*
+ * Copies a string which has no other owner in the arena of the preprocessor, it is released
+ * together with the translation unit
+ */
+llvm::StringRef copyToArena(clang::Preprocessor& PP, const std::string& str) {
+	char* buf = static_cast<char*>(PP.getPreprocessorAllocator().Allocate(str.size(), 1));
+	std::copy(str.begin(), str.end(), buf);
+	return llvm::StringRef(buf, str.size());
+}
+
+// bytes allocated on the heap by a small vector which outgrew its inline storage
+template <class T, unsigned N>
+size_t heapSize(const llvm::SmallVector<T, N>& vec) {
+	return vec.capacity() > N ? vec.capacity() * sizeof(T) : 0;
+}
+
 } // end anonymous namespace
 
 namespace clomp { 
 
 // ------------------------------------ ValueUnion ---------------------------
-ValueUnion::~ValueUnion() {
-	if ( ptrOwner && is<clang::Stmt*>() ) {
-		assert(clangCtx && "Invalid ASTContext associated with this element.");
-		clangCtx->Deallocate(get<Stmt*>());
-	}
-	if(ptrOwner && is<std::string*>())
-		delete get<std::string*>();
-}
-
 std::string ValueUnion::toStr() const {
+	if ( !isStmt() ) { return mStr.str(); }
+
 	std::string ret;
 	llvm::raw_string_ostream rs(ret);
-	if ( is<Stmt*>() ) {
-		get<Stmt*>()->printPretty(rs, 0, clangCtx->getPrintingPolicy());
-	} else {
-		rs << *get<std::string*>();
-	}
+	mStmt->printPretty(rs, 0, clangCtx->getPrintingPolicy());
 	return rs.str();
 }
 
@@ -68,23 +108,81 @@ std::ostream& ValueUnion::printTo(std::ostream& out) const {
 	return out << toStr();
 }
 
-MatchMap::MatchMap(const MatchMap& other) {
+// ------------------------------------ MatchKeyRegistry ---------------------------
+namespace {
 
-	std::for_each(other.cbegin(), other.cend(), [ this ](const MatchMap::value_type& curr) {
-		(*this)[curr.first] = ValueList();
-		ValueList& currList = (*this)[curr.first];
+struct KeyRegistry {
+	std::mutex 					mutex;
+	llvm::StringMap<MatchKey> 	ids;
+	// a deque never moves its elements, the names can be returned by reference
+	std::deque<std::string> 	names;
 
-		std::for_each(curr.second.cbegin(), curr.second.cend(), [ &currList ](const ValueList::value_type& elem) {
-			currList.push_back( ValueUnionPtr( new ValueUnion(*elem, true) ) );
-		});
-	});
+	static KeyRegistry& get() {
+		static KeyRegistry registry;
+		return registry;
+	}
+};
+
+} // end anonymous namespace
+
+const MatchKey MatchKeyRegistry::NoKey;
+
+MatchKey MatchKeyRegistry::get(const std::string& name) {
+	KeyRegistry& reg = KeyRegistry::get();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+
+	llvm::StringMapEntry<MatchKey>& entry = reg.ids.GetOrCreateValue(name, static_cast<MatchKey>(reg.names.size()));
+	if (entry.getValue() == reg.names.size()) { reg.names.push_back(name); }
+	return entry.getValue();
+}
+
+MatchKey MatchKeyRegistry::lookup(const std::string& name) {
+	KeyRegistry& reg = KeyRegistry::get();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+
+	auto fit = reg.ids.find(name);
+	return fit == reg.ids.end() ? NoKey : fit->second;
+}
+
+const std::string& MatchKeyRegistry::getName(MatchKey key) {
+	KeyRegistry& reg = KeyRegistry::get();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+
+	assert(key < reg.names.size() && "Unknown matcher map key");
+	return reg.names[key];
+}
+
+// ------------------------------------ MatchMap ---------------------------
+ValueList& MatchMap::operator[](MatchKey key) {
+	assert(key != MatchKeyRegistry::NoKey && "Invalid matcher map key");
+
+	if (key >= mSlots.size()) { mSlots.resize(key+1, 0); }
+	if (!mSlots[key]) {
+		assert(mEntries.size() < 255 && "Too many keys in a matcher map");
+		mEntries.push_back( value_type(key, ValueList()) );
+		mSlots[key] = static_cast<unsigned char>(mEntries.size());
+	}
+	return mEntries[mSlots[key]-1].second;
+}
+
+MatchMap::const_iterator MatchMap::find(MatchKey key) const {
+	if (key >= mSlots.size() || !mSlots[key]) { return end(); }
+	return begin() + (mSlots[key]-1);
+}
+
+size_t MatchMap::getAllocatedSize() const {
+	size_t size = heapSize(mSlots) + heapSize(mEntries);
+	for (const_iterator it = begin(), end = this->end(); it != end; ++it) {
+		size += heapSize(it->second);
+	}
+	return size;
 }
 
 std::ostream& MatchMap::printTo(std::ostream& out) const {
 	for_each(begin(), end(), [&] ( const MatchMap::value_type& cur ) { 
-				out << "KEY: '" << cur.first << "' -> ";
+				out << "KEY: '" << getKeyName(cur.first) << "' -> ";
 	//			out << "[" << join(", ", cur.second, 
-	//				[](std::ostream& out, const ValueUnionPtr& cur){ out << *cur; } ) << "]";
+	//				[](std::ostream& out, const ValueUnion& cur){ out << cur; } ) << "]";
 				out << std::endl;
 			});
 	return out;
@@ -92,14 +190,25 @@ std::ostream& MatchMap::printTo(std::ostream& out) const {
 
 // ------------------------------------ ParserStack ---------------------------
 
+void ParserStack::startRecording() {
+	mRecords.clear();
+	mRecordId = 0;
+	mRecording = true;
+}
+
 size_t ParserStack::openRecord() {
+	if (!mRecording) { return 0; }
 	mRecords.push_back( LocErrorList() );
 	return mRecordId++;
 }
 
-void ParserStack::addExpected(size_t recordId, const Error& pe) { mRecords[recordId].push_back(pe); }
+void ParserStack::addExpected(size_t recordId, const Error& pe) { 
+	if (mRecording) { mRecords[recordId].push_back(pe); }
+}
 
-void ParserStack::discardRecord(size_t recordId) { mRecords[recordId] = LocErrorList(); }
+void ParserStack::discardRecord(size_t recordId) { 
+	if (mRecording) { mRecords[recordId] = LocErrorList(); }
+}
 
 size_t ParserStack::getFirstValidRecord() {
 	for ( size_t i=0; i<mRecords.size(); ++i )
@@ -108,6 +217,7 @@ size_t ParserStack::getFirstValidRecord() {
 }
 
 void ParserStack::discardPrevRecords(size_t recordId) {
+	if (!mRecording) { return; }
 
 	std::for_each(mRecords.begin(), mRecords.begin()+recordId, [](ParserStack::LocErrorList& cur) {
 		cur = ParserStack::LocErrorList();
@@ -154,20 +264,34 @@ star node::operator*() const { return star(*this); }
 choice node::operator|(node const& n) const { return choice(*this, n); }
 option node::operator!() const { return option(*this); }
 
-bool concat::match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
-	int id = errStack.openRecord();
+bool node::MatchPragma(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack) const {
+	if (errStack.isRecording()) { return match(PP, mmap, errStack, errStack.openRecord()); }
+
+	// valid pragmas are matched without any error bookkeeping
 	PP.EnableBacktrackAtThisPos();
-	if (first->match(PP, mmap, errStack, id)) {
-		errStack.discardPrevRecords(id);
-		id = errStack.openRecord();
-		if(second->match(PP, mmap, errStack, id)) {
-			PP.CommitBacktrackedTokens();
-			errStack.discardRecord(id);
-			return true;
-		}
+	if (match(PP, mmap, errStack, errStack.openRecord())) {
+		PP.CommitBacktrackedTokens();
+		return true;
 	}
 	PP.Backtrack();
-	return false;
+	countStat(&ParseStats::backtracks);
+
+	// the pragma is matched again to collect the expected tokens, the diagnostics emitted by 
+	// clang (e.g. for an invalid clause expression) have already been reported by the first run
+	clang::DiagnosticsEngine& diags = PP.getDiagnostics();
+	bool suppressed = diags.getSuppressAllDiagnostics();
+	diags.setSuppressAllDiagnostics(true);
+
+	MatchMap().swap(mmap);
+	errStack.startRecording();
+	bool matched = match(PP, mmap, errStack, errStack.openRecord());
+
+	diags.setSuppressAllDiagnostics(suppressed);
+	return matched;
+}
+
+bool concat::match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+	return matchConcat(PP, mmap, errStack, *first, *second);
 }
 
 bool star::match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
@@ -176,22 +300,175 @@ bool star::match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack,
 	return true;
 }
 
+// ------------------------------------ FirstSet ---------------------------
+void FirstSet::merge(const FirstSet& other) {
+	keywords.insert(other.keywords.begin(), other.keywords.end());
+	tokens.insert(other.tokens.begin(), other.tokens.end());
+	anyIdentifier |= other.anyIdentifier;
+	anyToken |= other.anyToken;
+	nullable |= other.nullable;
+}
+
+bool FirstSet::contains(const clang::Token& token) const {
+	if (anyToken || nullable) { return true; }
+	if (token.is(clang::tok::identifier)) {
+		return anyIdentifier || 
+			(token.getIdentifierInfo() && keywords.count(token.getIdentifierInfo()->getName().str()));
+	}
+	return tokens.count(token.getKind());
+}
+
+FirstSet node::getFirst() const {
+	FirstSet first;
+	first.anyToken = true;
+	return first;
+}
+
+FirstSet concat::getFirst() const {
+	FirstSet ret = first->getFirst();
+	if (ret.nullable) {
+		// the second node can start the match, the concatenation is nullable only if both are
+		FirstSet&& next = second->getFirst();
+		ret.merge(next);
+		ret.nullable = next.nullable;
+	}
+	return ret;
+}
+
+FirstSet choice::getFirst() const {
+	FirstSet ret = first->getFirst();
+	ret.merge(second->getFirst());
+	return ret;
+}
+
+FirstSet option::getFirst() const {
+	FirstSet ret = getNode()->getFirst();
+	ret.nullable = true;
+	return ret;
+}
+
+FirstSet star::getFirst() const {
+	FirstSet ret = getNode()->getFirst();
+	ret.nullable = true;
+	return ret;
+}
+
+// ------------------------------------ DispatchTable ---------------------------
+DispatchTable::DispatchTable(const std::vector<FirstSet>& firsts) {
+	// the keys of the table are the keywords and the tokens which start any of the alternatives
+	FirstSet all;
+	std::for_each(firsts.begin(), firsts.end(), [&](const FirstSet& cur) { all.merge(cur); });
+	std::for_each(all.keywords.begin(), all.keywords.end(), [&](const std::string& cur) { mKeywords[cur]; });
+	std::for_each(all.tokens.begin(), all.tokens.end(), [&](clang::tok::TokenKind cur) { mTokens[cur]; });
+
+	for (unsigned i = 0; i < firsts.size(); ++i) {
+		const FirstSet& first = firsts[i];
+		const bool any = first.anyToken || first.nullable;
+
+		for (llvm::StringMap<std::vector<unsigned>>::iterator it = mKeywords.begin(), end = mKeywords.end(); it != end; ++it) {
+			if (any || first.anyIdentifier || first.keywords.count(it->getKey().str())) { it->getValue().push_back(i); }
+		}
+		for (auto it = mTokens.begin(), end = mTokens.end(); it != end; ++it) {
+			if (any || first.tokens.count(it->first)) { it->second.push_back(i); }
+		}
+		if (any || first.anyIdentifier) { mIdentifiers.push_back(i); }
+		if (any) { mOthers.push_back(i); }
+
+		std::vector<std::string> expected;
+		std::for_each(first.keywords.begin(), first.keywords.end(), [&](const std::string& cur) {
+			expected.push_back("\'" + cur + "\'");
+		});
+		std::for_each(first.tokens.begin(), first.tokens.end(), [&](clang::tok::TokenKind cur) {
+			expected.push_back("\'" + TokenToStr(cur) + "\'");
+		});
+		if (first.anyIdentifier) { expected.push_back("\'" + TokenToStr(clang::tok::identifier) + "\'"); }
+		mExpected.push_back(expected);
+	}
+}
+
+const std::vector<unsigned>& DispatchTable::getCandidates(const clang::Token& token) const {
+	if (token.is(clang::tok::identifier)) {
+		if (token.getIdentifierInfo()) {
+			auto fit = mKeywords.find(token.getIdentifierInfo()->getName());
+			if (fit != mKeywords.end()) { return fit->getValue(); }
+		}
+		return mIdentifiers;
+	}
+	auto fit = mTokens.find(token.getKind());
+	return fit != mTokens.end() ? fit->second : mOthers;
+}
+
+/**
+ * Dispatch table of a chain of choices together with its alternatives
+ */
+struct choice::Dispatch {
+	std::vector<const node*> 		alternatives;
+	std::unique_ptr<DispatchTable> 	table;
+};
+
+namespace {
+
+// collects the alternatives of a chain of choices, in the order they are tried
+void flattenChoice(const node* n, std::vector<const node*>& alternatives) {
+	if (const choice* c = dynamic_cast<const choice*>(n)) {
+		flattenChoice(c->first, alternatives);
+		flattenChoice(c->second, alternatives);
+		return;
+	}
+	alternatives.push_back(n);
+}
+
+} // end anonymous namespace
+
+choice::choice(node const& n1, node const& n2) : val_pair<choice>::val_pair(n1.copy(), n2.copy()) { }
+
+choice::choice(const choice& other) : val_pair<choice>::val_pair(other.first->copy(), other.second->copy()) { }
+
+choice::~choice() { }
+
+void choice::buildDispatch() const {
+	Dispatch* d = new Dispatch;
+	flattenChoice(this, d->alternatives);
+
+	std::vector<FirstSet> firsts;
+	std::for_each(d->alternatives.begin(), d->alternatives.end(), [&](const node* cur) { 
+		firsts.push_back(cur->getFirst());
+	});
+	d->table.reset( new DispatchTable(firsts) );
+	mDispatch.reset(d);
+}
+
 bool choice::match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+	std::call_once(mDispatchInit, [this]() { buildDispatch(); });
+	const Dispatch& d = *mDispatch;
+
+	// the alternatives which can start with the next token
+	const clang::SourceLocation loc = PP.LookAhead(0).getLocation();
+	const std::vector<unsigned>& candidates = d.table->getCandidates(PP.LookAhead(0));
+
 	int id = errStack.openRecord();
-	PP.EnableBacktrackAtThisPos();
-	if (first->match(PP, mmap, errStack, id)) {
-		PP.CommitBacktrackedTokens();
-		errStack.discardRecord(id);
-		return true;
+	for (auto it = candidates.begin(), end = candidates.end(); it != end; ++it) {
+		PP.EnableBacktrackAtThisPos();
+		if (d.alternatives[*it]->match(PP, mmap, errStack, id)) {
+			PP.CommitBacktrackedTokens();
+			errStack.discardRecord(id);
+			return true;
+		}
+		PP.Backtrack();
+		countStat(&ParseStats::backtracks);
 	}
-	PP.Backtrack();
-	PP.EnableBacktrackAtThisPos();
-	if (second->match(PP, mmap, errStack, id)) {
-		PP.CommitBacktrackedTokens();
-		errStack.discardRecord(id);
-		return true;
+
+	if (!errStack.isRecording()) { return false; }
+
+	// the alternatives which were not tried would have failed on the next token
+	auto cand = candidates.begin();
+	for (unsigned i = 0; i < d.alternatives.size(); ++i) {
+		if (cand != candidates.end() && *cand == i) { ++cand; continue; }
+		const std::vector<std::string>& expected = d.table->getExpected(i);
+		std::for_each(expected.begin(), expected.end(), [&](const std::string& cur) {
+			errStack.addExpected(id, ParserStack::Error(cur, loc));
+		});
 	}
-	PP.Backtrack();
 	return false;
 }
 
@@ -202,10 +479,25 @@ bool option::match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStac
 		return true;
 	}
 	PP.Backtrack();
+	countStat(&ParseStats::backtracks);
 	return true;
 }
 
-bool expr_p::match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+bool matchExpression(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID, MatchKey key) {
+	// no parser available, the expression is kept as a token span
+	if (!ParserProxy::get().getParser()) {
+		std::string spelling;
+		if (!matchExprTokens(PP, spelling)) {
+			if (errStack.isRecording()) {
+				errStack.addExpected(recID, ParserStack::Error("expr", PP.LookAhead(0).getLocation()));
+			}
+			return false;
+		}
+		if (key != MatchKeyRegistry::NoKey)
+			mmap[key].push_back( ValueUnion(copyToArena(PP, spelling)) );
+		return true;
+	}
+
 	// ClangContext::get().getParser()->Tok.setKind(*firstTok);
 	PP.EnableBacktrackAtThisPos();
 	Expr* result = ParserProxy::get().ParseExpression(PP);
@@ -214,29 +506,59 @@ bool expr_p::match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStac
 		PP.CommitBacktrackedTokens();
 		ParserProxy::get().EnterTokenStream(PP);
 		PP.LookAhead(1); // THIS IS CRAZY BUT IT WORKS
-		if (getMapName().size())
-			mmap[getMapName()].push_back( ValueUnionPtr(
-				new ValueUnion(result, &static_cast<clang::Sema&>(ParserProxy::get().getParser()->getActions()).Context)
-			));
+		if (key != MatchKeyRegistry::NoKey)
+			mmap[key].push_back( 
+				ValueUnion(result, &static_cast<clang::Sema&>(ParserProxy::get().getParser()->getActions()).Context)
+			);
 		return true;
 	}
 	PP.Backtrack();
-	errStack.addExpected(recID, ParserStack::Error("expr", ParserProxy::get().CurrentToken().getLocation()));
+	countStat(&ParseStats::backtracks);
+	if (errStack.isRecording()) {
+		errStack.addExpected(recID, ParserStack::Error("expr", ParserProxy::get().CurrentToken().getLocation()));
+	}
 	return false;
 }
 
-bool kwd::match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+bool expr_p::match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+	return matchExpression(PP, mmap, errStack, recID, getMapKey());
+}
+
+bool matchToken(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID, 
+				clang::tok::TokenKind kind, bool resolve, MatchKey key, bool addToMap) 
+{
 	clang::Token& token = ParserProxy::get().ConsumeToken();
-	if (token.is(clang::tok::identifier) && ParserProxy::get().CurrentToken().getIdentifierInfo()->getName() == kw) {
-		if(isAddToMap() && getMapName().empty())
-			mmap[kw];
-		else if(isAddToMap())
-			mmap[getMapName()].push_back( ValueUnionPtr(new ValueUnion( kw )) );
+	if (token.is(kind)) {
+		if (addToMap) { AddToMap(kind, token, resolve, key, mmap); }
 		return true;
 	}
-	errStack.addExpected(recID, ParserStack::Error("\'" + kw + "\'", token.getLocation()));
+	if (errStack.isRecording()) {
+		errStack.addExpected(recID, ParserStack::Error("\'" + TokenToStr(kind) + "\'", token.getLocation()));
+	}
 	return false;
 }
+
+bool matchKeyword(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID, 
+				  const std::string& kw, MatchKey kwKey, MatchKey key, bool addToMap) 
+{
+	clang::Token& token = ParserProxy::get().ConsumeToken();
+	if (token.is(clang::tok::identifier) && token.getIdentifierInfo() && token.getIdentifierInfo()->getName() == kw) {
+		if(addToMap && key == MatchKeyRegistry::NoKey)
+			mmap[kwKey];
+		else if(addToMap)
+			// the spelling is owned by the identifier table
+			mmap[key].push_back( ValueUnion(token.getIdentifierInfo()->getName()) );
+		return true;
+	}
+	if (errStack.isRecording()) {
+		errStack.addExpected(recID, ParserStack::Error("\'" + kw + "\'", token.getLocation()));
+	}
+	return false;
+}
+
+bool kwd::match(clang::Preprocessor& PP, MatchMap& mmap, ParserStack& errStack, size_t recID) const {
+	return matchKeyword(PP, mmap, errStack, recID, kw, kwKey, getMapKey(), isAddToMap());
+}
 std::string TokenToStr(clang::tok::TokenKind token) {
 	const char *name = clang::tok::getTokenSimpleSpelling(token);
 	if(name)
@@ -246,45 +568,45 @@ std::string TokenToStr(clang::tok::TokenKind token) {
 }
 
 std::string TokenToStr(const clang::Token& token) {
+	return TokenSpelling(token).str();
+}
+
+llvm::StringRef TokenSpelling(const clang::Token& token) {
 	if (token.isLiteral()) {
-		return std::string(token.getLiteralData(), token.getLiteralData() + token.getLength());
-	} else {
-		return TokenToStr(token.getKind());
+		return llvm::StringRef(token.getLiteralData(), token.getLength());
 	}
+	// keywords (e.g. 'static') are spelled as their identifier
+	if (const clang::IdentifierInfo* info = token.getIdentifierInfo()) {
+		return info->getName();
+	}
+	const char *name = clang::tok::getTokenSimpleSpelling(token.getKind());
+	return name ? name : clang::tok::getTokenName(token.getKind());
 }
 
-void AddToMap(clang::tok::TokenKind tok, Token const& token, bool resolve, std::string const& map_str, MatchMap& mmap) {
-	if (!map_str.size()) { return; }
-
-	Sema& A = ParserProxy::get().getParser()->getActions();
+void AddToMap(clang::tok::TokenKind tok, Token const& token, bool resolve, MatchKey key, MatchMap& mmap) {
+	if (key == MatchKeyRegistry::NoKey) { return; }
 
 	// HACK: FIXME
 	// this hacks make it possible that if we have a token and we just want its string value 
 	// we do not invoke clang semantics action on it. 
-	if (!resolve) {
+	// In lexer mode there is no semantics to invoke, only the string value is stored.
+	if (!resolve || !ParserProxy::get().getParser()) {
 		if (tok == clang::tok::identifier) {
-			UnqualifiedId Name;
-			Name.setIdentifier(token.getIdentifierInfo(), token.getLocation());
-			mmap[map_str].push_back( 
-				ValueUnionPtr(new ValueUnion(
-					std::string(
-						Name.Identifier->getNameStart(), 
-						Name.Identifier->getLength()
-					)
-				))
-			);
+			mmap[key].push_back( ValueUnion(token.getIdentifierInfo()->getName()) );
 			return;
 		}
-		mmap[map_str].push_back( ValueUnionPtr(new ValueUnion(TokenToStr(token))) );
+		mmap[key].push_back( ValueUnion(TokenSpelling(token)) );
 		return ;
 	}
 
+	Sema& A = ParserProxy::get().getParser()->getActions();
+
 	// We want to use clang sema to actually get the Clang node which is found out of this
 	// identifier 
 	switch (tok) {
 	case clang::tok::numeric_constant:
-		mmap[map_str].push_back(ValueUnionPtr(
-			new ValueUnion(A.ActOnNumericConstant(token).takeAs<IntegerLiteral>(), &static_cast<clang::Sema&>(A).Context))
+		mmap[key].push_back(
+			ValueUnion(A.ActOnNumericConstant(token).takeAs<IntegerLiteral>(), &static_cast<clang::Sema&>(A).Context)
 		);
 		break;
 	case clang::tok::identifier: {
@@ -301,17 +623,15 @@ void AddToMap(clang::tok::TokenKind tok, Token const& token, bool resolve, std::
 
 		auto varDecl = res.getAsSingle<clang::VarDecl>();
 
-		mmap[map_str].push_back(
-			ValueUnionPtr(
-				new ValueUnion(
-					new (A.Context) clang::DeclRefExpr(varDecl, false, varDecl->getType(), VK_LValue, varDecl->getLocation()),
-					&A.Context
-				)
+		mmap[key].push_back(
+			ValueUnion(
+				new (A.Context) clang::DeclRefExpr(varDecl, false, varDecl->getType(), VK_LValue, varDecl->getLocation()),
+				&A.Context
 			));
 		break;
 	}
 	default: {
-		mmap[map_str].push_back( ValueUnionPtr(new ValueUnion(TokenToStr(token))) );
+		mmap[key].push_back( ValueUnion(TokenSpelling(token)) );
 		break;
 	}
 	}
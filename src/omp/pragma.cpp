@@ -9,6 +9,7 @@
 
 #include "handler.h"
 #include "matcher.h"
+#include "grammar.h"
 
 #include "utils/source_locations.h"
 
@@ -28,8 +29,8 @@ struct OmpPragma ## TYPE: public OmpPragma { \
 	OmpPragma ## TYPE(const clang::SourceLocation& 	startLoc, \
 				      const clang::SourceLocation& 	endLoc,	\
 					  const std::string& 			name, \
-					  const MatchMap& 				mmap):	\
-		OmpPragma(startLoc, endLoc, name, mmap) { }	\
+					  MatchMap&& 					mmap):	\
+		OmpPragma(startLoc, endLoc, name, std::move(mmap)) { }	\
 	virtual omp::AnnotationPtr toAnnotation() const; 	\
 }
 
@@ -53,8 +54,27 @@ OMP_PRAGMA(ThreadPrivate);
 
 namespace clomp { namespace omp {
 
-void registerPragmaHandlers(clang::Preprocessor& pp) {
-	using namespace clomp::tok;
+namespace {
+
+/**
+ * Holds the matchers of the OpenMP pragmas. The grammar is built only once and
+ * shared among the pragma handlers of every preprocessor.
+ */
+struct OmpGrammar {
+	typedef std::shared_ptr<node> NodePtr;
+
+	NodePtr parallel, for_, sections, section, single, task, master, critical,
+			barrier, taskwait, atomic, flush, ordered, threadprivate;
+
+	OmpGrammar();
+};
+
+OmpGrammar::OmpGrammar() {
+	// the grammar is statically typed, each pragma is matched by a single virtual call
+	namespace tok = grammar::tok;
+	using namespace grammar::tok;
+	using grammar::kwd;
+	using grammar::Tok;
 
 	// if(scalar-expression)
 	auto if_expr 		   	= kwd("if") >> l_paren >> tok::expr["if"] >> r_paren;
@@ -138,7 +158,7 @@ void registerPragmaHandlers(clang::Preprocessor& pp) {
 	auto parallel_for_clause_list = (parallel_clause | for_clause | sections_clause) >>
 										*( !comma >> (parallel_clause | for_clause | sections_clause) );
 
-	auto parallel_clause_list = !( 	(Tok<clang::tok::kw_for>("for") >> !parallel_for_clause_list)
+	auto parallel_clause_list = !( 	(Tok<clang::tok::kw_for>()["for"] >> !parallel_for_clause_list)
 								 |  (kwd("sections") >> !parallel_for_clause_list)
 								 | 	(parallel_clause >> *(!comma >> parallel_clause))
 								 );
@@ -174,6 +194,30 @@ void registerPragmaHandlers(clang::Preprocessor& pp) {
 	// threadprivate(list)
 	auto threadprivate_clause = l_paren >> var_list["thread_private"] >> r_paren;
 
+
+	// #pragma omp parallel [clause[ [, ]clause] ...] new-line
+	parallel 		= grammar::makeRule(parallel_clause_list >> tok::eod);
+	for_ 			= grammar::makeRule(for_clause_list >> tok::eod);
+	sections 		= grammar::makeRule(sections_clause_list >> tok::eod);
+	single 			= grammar::makeRule(single_clause_list >> tok::eod);
+	task 			= grammar::makeRule(task_clause_list >> tok::eod);
+	// #pragma omp critical [(name)] new-line
+	critical 		= grammar::makeRule(!(l_paren >> identifier["critical"] >> r_paren) >> tok::eod);
+	// #pragma omp flush [(list)] new-line
+	flush 			= grammar::makeRule(!(l_paren >> var_list["flush"] >> r_paren) >> tok::eod);
+	// #pragma omp threadprivate(list) new-line
+	threadprivate 	= grammar::makeRule(threadprivate_clause >> tok::eod);
+
+	// pragmas without clauses
+	section = master = barrier = taskwait = atomic = ordered = grammar::makeRule(tok::eod);
+}
+
+} // end anonymous namespace
+
+void registerPragmaHandlers(clang::Preprocessor& pp) {
+	// the grammar is built the first time a preprocessor is set up
+	static const OmpGrammar grammar;
+
 	// define a PragmaNamespace for omp
 	clang::PragmaNamespace* omp = new clang::PragmaNamespace("omp");
 	pp.AddPragmaHandler(omp);
@@ -181,71 +225,71 @@ void registerPragmaHandlers(clang::Preprocessor& pp) {
 	// Add an handler for pragma omp parallel:
 	// #pragma omp parallel [clause[ [, ]clause] ...] new-line
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaParallel>(
-			pp.getIdentifierInfo("parallel"), parallel_clause_list >> tok::eod, "omp")
+			pp.getIdentifierInfo("parallel"), grammar.parallel, "omp")
 		);
 
 	// omp for
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaFor>(
-			pp.getIdentifierInfo("for"), for_clause_list >> tok::eod, "omp")
+			pp.getIdentifierInfo("for"), grammar.for_, "omp")
 		);
 
 	// #pragma omp sections [clause[[,] clause] ...] new-line
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaSections>(
-			pp.getIdentifierInfo("sections"), sections_clause_list >> tok::eod, "omp")
+			pp.getIdentifierInfo("sections"), grammar.sections, "omp")
 		);
 
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaSection>(
-			pp.getIdentifierInfo("section"), tok::eod, "omp")
+			pp.getIdentifierInfo("section"), grammar.section, "omp")
 		);
 
 	// omp single
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaSingle>(
-			pp.getIdentifierInfo("single"), single_clause_list >> tok::eod, "omp")
+			pp.getIdentifierInfo("single"), grammar.single, "omp")
 		);
 
 	// #pragma omp task [clause[[,] clause] ...] new-line
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaTask>(
-			pp.getIdentifierInfo("task"), task_clause_list >> tok::eod, "omp")
+			pp.getIdentifierInfo("task"), grammar.task, "omp")
 		);
 
 	// #pragma omp master new-line
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaMaster>(
-			pp.getIdentifierInfo("master"), tok::eod, "omp")
+			pp.getIdentifierInfo("master"), grammar.master, "omp")
 		);
 
 	// #pragma omp critical [(name)] new-line
 	omp->AddPragma( PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaCritical>(
-			pp.getIdentifierInfo("critical"), !(l_paren >> identifier["critical"] >> r_paren) >> tok::eod, "omp")
+			pp.getIdentifierInfo("critical"), grammar.critical, "omp")
 		);
 
 	//#pragma omp barrier new-line
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaBarrier>(
-			pp.getIdentifierInfo("barrier"), tok::eod, "omp")
+			pp.getIdentifierInfo("barrier"), grammar.barrier, "omp")
 		);
 
 	// #pragma omp taskwait newline
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaTaskWait>(
-			pp.getIdentifierInfo("taskwait"), tok::eod, "omp")
+			pp.getIdentifierInfo("taskwait"), grammar.taskwait, "omp")
 		);
 
 	// #pragma omp atimic newline
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaAtomic>(
-			pp.getIdentifierInfo("atomic"), tok::eod, "omp")
+			pp.getIdentifierInfo("atomic"), grammar.atomic, "omp")
 		);
 
 	// #pragma omp flush [(list)] new-line
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaFlush>(
-			pp.getIdentifierInfo("flush"), !(l_paren >> var_list["flush"] >> r_paren) >> tok::eod, "omp")
+			pp.getIdentifierInfo("flush"), grammar.flush, "omp")
 		);
 
 	// #pragma omp ordered new-line
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaOrdered>(
-			pp.getIdentifierInfo("ordered"), tok::eod, "omp")
+			pp.getIdentifierInfo("ordered"), grammar.ordered, "omp")
 		);
 
 	// #pragma omp threadprivate(list) new-line
 	omp->AddPragma(PragmaHandlerFactory::CreatePragmaHandler<OmpPragmaThreadPrivate>(
-			pp.getIdentifierInfo("threadprivate"), threadprivate_clause >> tok::eod, "omp")
+			pp.getIdentifierInfo("threadprivate"), grammar.threadprivate, "omp")
 		);
 }
 
@@ -253,14 +297,14 @@ void registerPragmaHandlers(clang::Preprocessor& pp) {
 OmpPragma::OmpPragma(const clang::SourceLocation& startLoc, 
 					 const clang::SourceLocation& endLoc, 
 					 const string& name,
-					 const MatchMap& mmap) : 
-	Pragma(startLoc, endLoc, name, mmap), mMap(mmap) 
+					 MatchMap&& mmap) : 
+	Pragma(startLoc, endLoc, name), mMap(std::move(mmap)) 
 {
 //	std::cout << "~ OmpPragma ~" << std::endl;
 //	for(MatchMap::const_iterator i = mmap.begin(), e = mmap.end(); i!=e; ++i) {
 //		std::vector<std::string> strs(i->second.size());
 //		std::transform(i->second.begin(), i->second.end(), strs.begin(), 
-//				[](const ValueUnionPtr& cur){ return cur->toStr(); }
+//				[](const ValueUnion& cur){ return cur.toStr(); }
 //			);
 //		std::cout << "KEYWORD: " << i->first << ":\n\t{" << utils::join(strs) << "}" << std::endl;
 //	}
@@ -274,10 +318,37 @@ namespace {
 
 using namespace clomp;
 
+/**
+ * Ids of the keys of the matcher map looked up by the annotations, they are the ids given to the
+ * keys of the grammar
+ */
+namespace keys {
+const MatchKey if_			= MatchKeyRegistry::get("if");
+const MatchKey num_threads	= MatchKeyRegistry::get("num_threads");
+const MatchKey default_		= MatchKeyRegistry::get("default");
+const MatchKey private_		= MatchKeyRegistry::get("private");
+const MatchKey firstprivate	= MatchKeyRegistry::get("firstprivate");
+const MatchKey lastprivate	= MatchKeyRegistry::get("lastprivate");
+const MatchKey shared		= MatchKeyRegistry::get("shared");
+const MatchKey copyin		= MatchKeyRegistry::get("copyin");
+const MatchKey copyprivate	= MatchKeyRegistry::get("copyprivate");
+const MatchKey reduction	= MatchKeyRegistry::get("reduction");
+const MatchKey reduction_op	= MatchKeyRegistry::get("reduction_op");
+const MatchKey schedule		= MatchKeyRegistry::get("schedule");
+const MatchKey chunk_size	= MatchKeyRegistry::get("chunk_size");
+const MatchKey collapse		= MatchKeyRegistry::get("collapse");
+const MatchKey for_			= MatchKeyRegistry::get("for");
+const MatchKey sections		= MatchKeyRegistry::get("sections");
+const MatchKey nowait		= MatchKeyRegistry::get("nowait");
+const MatchKey untied		= MatchKeyRegistry::get("untied");
+const MatchKey critical		= MatchKeyRegistry::get("critical");
+const MatchKey flush		= MatchKeyRegistry::get("flush");
+} // end keys namespace
+
 /**
  * Create an annotation with the list of identifiers, used for clauses: private,firstprivate,lastprivate
  */
-VarListPtr handleIdentifierList(const MatchMap& mmap, const std::string& key) {
+VarListPtr handleIdentifierList(const MatchMap& mmap, MatchKey key) {
 
 	auto fit = mmap.find(key);
 	if(fit == mmap.end())
@@ -286,7 +357,7 @@ VarListPtr handleIdentifierList(const MatchMap& mmap, const std::string& key) {
 	const ValueList& vars = fit->second;
 	VarList* varList = new VarList;
 	for(ValueList::const_iterator it = vars.begin(), end = vars.end(); it != end; ++it) {
-		clang::Stmt* varIdent = (*it)->get<clang::Stmt*>();
+		clang::Stmt* varIdent = it->getStmt();
 		assert(varIdent && "Clause not containing var exps");
 
 		clang::DeclRefExpr* refVarIdent = llvm::dyn_cast<clang::DeclRefExpr>(varIdent);
@@ -300,35 +371,35 @@ VarListPtr handleIdentifierList(const MatchMap& mmap, const std::string& key) {
 // operator = + or - or * or & or | or ^ or && or ||
 ReductionPtr handleReductionClause(const MatchMap& mmap) {
 
-	auto fit = mmap.find("reduction");
+	auto fit = mmap.find(keys::reduction);
 	if(fit == mmap.end())
 		return ReductionPtr();
 
 	// we have a reduction
 	// check the operator
-	auto opIt = mmap.find("reduction_op");
+	auto opIt = mmap.find(keys::reduction_op);
 	assert(opIt != mmap.end() && "Reduction clause doesn't contains an operator");
 	const ValueList& opVar = opIt->second;
 	assert(opVar.size() == 1);
 
-	std::string* opStr = opVar.front()->get<std::string*>();
-	assert(opStr && "Reduction clause with no operator");
+	llvm::StringRef opStr = opVar.front().getString();
+	assert(!opStr.empty() && "Reduction clause with no operator");
 
 	Reduction::Operator op;
-	if(*opStr == "+")		op = Reduction::PLUS;
-	else if(*opStr == "-")	op = Reduction::MINUS;
-	else if(*opStr == "*")	op = Reduction::STAR;
-	else if(*opStr == "&")	op = Reduction::AND;
-	else if(*opStr == "|")	op = Reduction::OR;
-	else if(*opStr == "^")	op = Reduction::XOR;
-	else if(*opStr == "&&")	op = Reduction::LAND;
-	else if(*opStr == "||")	op = Reduction::LOR;
+	if(opStr == "+")		op = Reduction::PLUS;
+	else if(opStr == "-")	op = Reduction::MINUS;
+	else if(opStr == "*")	op = Reduction::STAR;
+	else if(opStr == "&")	op = Reduction::AND;
+	else if(opStr == "|")	op = Reduction::OR;
+	else if(opStr == "^")	op = Reduction::XOR;
+	else if(opStr == "&&")	op = Reduction::LAND;
+	else if(opStr == "||")	op = Reduction::LOR;
 	else assert(false && "Reduction operator not supported.");
 
-	return std::make_shared<Reduction>(op, handleIdentifierList(mmap, "reduction"));
+	return std::make_shared<Reduction>(op, handleIdentifierList(mmap, keys::reduction));
 }
 
-const clang::Expr* handleSingleExpression(const MatchMap& mmap, const std::string& key) {
+const clang::Expr* handleSingleExpression(const MatchMap& mmap, MatchKey key) {
 
 	auto fit = mmap.find(key);
 	if(fit == mmap.end()) { return NULL; }
@@ -336,7 +407,7 @@ const clang::Expr* handleSingleExpression(const MatchMap& mmap, const std::strin
 	// we have an expression
 	const ValueList& expr = fit->second;
 	assert(expr.size() == 1);
-	clang::Expr* collapseExpr = llvm::dyn_cast<clang::Expr>(expr.front()->get<clang::Stmt*>());
+	clang::Expr* collapseExpr = llvm::dyn_cast<clang::Expr>(expr.front().getStmt());
 	assert(collapseExpr && "OpenMP collapse clause's expression is not of type clang::Expr");
 	return collapseExpr;
 }
@@ -344,14 +415,14 @@ const clang::Expr* handleSingleExpression(const MatchMap& mmap, const std::strin
 // schedule( (static | dynamic | guided | atuo | runtime) (, chunk_size) )
 SchedulePtr handleScheduleClause(const MatchMap& mmap) {
 
-	auto fit = mmap.find("schedule");
+	auto fit = mmap.find(keys::schedule);
 	if(fit == mmap.end())
 		return SchedulePtr();
 
 	// we have a schedule clause
 	const ValueList& kind = fit->second;
 	assert(kind.size() == 1);
-	std::string& kindStr = *kind.front()->get<std::string*>();
+	llvm::StringRef kindStr = kind.front().getString();
 
 	Schedule::Kind k;
 	if(kindStr == "static")
@@ -368,25 +439,25 @@ SchedulePtr handleScheduleClause(const MatchMap& mmap) {
 		assert(false && "Unsupported scheduling kind");
 
 	// check for chunk_size expression
-	const clang::Expr* chunkSize = handleSingleExpression(mmap, "chunk_size");
+	const clang::Expr* chunkSize = handleSingleExpression(mmap, keys::chunk_size);
 	return std::make_shared<Schedule>(k, chunkSize);
 }
 
-bool hasKeyword(const MatchMap& mmap, const std::string& key) {
+bool hasKeyword(const MatchMap& mmap, MatchKey key) {
 	auto fit = mmap.find(key);
 	return fit != mmap.end();
 }
 
 DefaultPtr handleDefaultClause(const MatchMap& mmap) {
 
-	auto fit = mmap.find("default");
+	auto fit = mmap.find(keys::default_);
 	if(fit == mmap.end())
 		return DefaultPtr();
 
 	// we have a schedule clause
 	const ValueList& kind = fit->second;
 	assert(kind.size() == 1);
-	std::string& kindStr = *kind.front()->get<std::string*>();
+	llvm::StringRef kindStr = kind.front().getString();
 
 	Default::Kind k;
 	if(kindStr == "shared")
@@ -411,32 +482,32 @@ DefaultPtr handleDefaultClause(const MatchMap& mmap) {
 AnnotationPtr OmpPragmaParallel::toAnnotation() const {
 	const MatchMap& map = getMap();
 	// check for if clause
-	const clang::Expr*	ifClause = handleSingleExpression(map, "if");
+	const clang::Expr*	ifClause = handleSingleExpression(map, keys::if_);
 	// check for num_threads clause
-	const clang::Expr*	numThreadsClause = handleSingleExpression(map, "num_threads");
+	const clang::Expr*	numThreadsClause = handleSingleExpression(map, keys::num_threads);
 	// check for default clause
 	DefaultPtr defaultClause = handleDefaultClause(map);
 	// check for private clause
-	VarListPtr privateClause = handleIdentifierList(map, "private");
+	VarListPtr privateClause = handleIdentifierList(map, keys::private_);
 	// check for firstprivate clause
-	VarListPtr firstPrivateClause = handleIdentifierList(map, "firstprivate");
+	VarListPtr firstPrivateClause = handleIdentifierList(map, keys::firstprivate);
 	// check for shared clause
-	VarListPtr sharedClause = handleIdentifierList(map, "shared");
+	VarListPtr sharedClause = handleIdentifierList(map, keys::shared);
 	// check for copyin clause
-	VarListPtr copyinClause = handleIdentifierList(map, "copyin");
+	VarListPtr copyinClause = handleIdentifierList(map, keys::copyin);
 	// check for reduction clause
 	ReductionPtr reductionClause = handleReductionClause(map);
 
 	// check for 'for'
-	if(hasKeyword(map, "for")) {
+	if(hasKeyword(map, keys::for_)) {
 		// this is a parallel for
-		VarListPtr lastPrivateClause = handleIdentifierList(map, "lastprivate");
+		VarListPtr lastPrivateClause = handleIdentifierList(map, keys::lastprivate);
 		// check for schedule clause
 		SchedulePtr scheduleClause = handleScheduleClause(map);
 		// check for collapse cluase
-		const clang::Expr*	collapseClause = handleSingleExpression(map, "collapse");
+		const clang::Expr*	collapseClause = handleSingleExpression(map, keys::collapse);
 		// check for nowait keyword
-		bool noWait = hasKeyword(map, "nowait");
+		bool noWait = hasKeyword(map, keys::nowait);
 
 		return std::make_shared<ParallelFor>(ifClause, numThreadsClause, 
 				defaultClause, privateClause, firstPrivateClause, sharedClause, 
@@ -445,11 +516,11 @@ AnnotationPtr OmpPragmaParallel::toAnnotation() const {
 	}
 
 	// check for 'sections'
-	if(hasKeyword(map, "sections")) {
+	if(hasKeyword(map, keys::sections)) {
 		// this is a parallel for
-		VarListPtr lastPrivateClause = handleIdentifierList(map, "lastprivate");
+		VarListPtr lastPrivateClause = handleIdentifierList(map, keys::lastprivate);
 		// check for nowait keyword
-		bool noWait = hasKeyword(map, "nowait");
+		bool noWait = hasKeyword(map, keys::nowait);
 
 		return std::make_shared<ParallelSections>(
 			ifClause, numThreadsClause, defaultClause, privateClause,
@@ -468,19 +539,19 @@ AnnotationPtr OmpPragmaParallel::toAnnotation() const {
 AnnotationPtr OmpPragmaFor::toAnnotation() const {
 	const MatchMap& map = getMap();
 	// check for private clause
-	VarListPtr privateClause = handleIdentifierList(map, "private");
+	VarListPtr privateClause = handleIdentifierList(map, keys::private_);
 	// check for firstprivate clause
-	VarListPtr firstPrivateClause = handleIdentifierList(map, "firstprivate");
+	VarListPtr firstPrivateClause = handleIdentifierList(map, keys::firstprivate);
 	// check for lastprivate clause
-	VarListPtr lastPrivateClause = handleIdentifierList(map, "lastprivate");
+	VarListPtr lastPrivateClause = handleIdentifierList(map, keys::lastprivate);
 	// check for reduction clause
 	ReductionPtr reductionClause = handleReductionClause(map);
 	// check for schedule clause
 	SchedulePtr scheduleClause = handleScheduleClause(map);
 	// check for collapse cluase
-	const clang::Expr*	collapseClause = handleSingleExpression(map, "collapse");
+	const clang::Expr*	collapseClause = handleSingleExpression(map, keys::collapse);
 	// check for nowait keyword
-	bool noWait = hasKeyword(map, "nowait");
+	bool noWait = hasKeyword(map, keys::nowait);
 
 	return std::make_shared<For>( privateClause, firstPrivateClause, lastPrivateClause,
 								  reductionClause, scheduleClause, collapseClause, noWait );
@@ -495,15 +566,15 @@ AnnotationPtr OmpPragmaFor::toAnnotation() const {
 AnnotationPtr OmpPragmaSections::toAnnotation() const {
 	const MatchMap& map = getMap();
 	// check for private clause
-	VarListPtr privateClause = handleIdentifierList(map, "private");
+	VarListPtr privateClause = handleIdentifierList(map, keys::private_);
 	// check for firstprivate clause
-	VarListPtr firstPrivateClause = handleIdentifierList(map, "firstprivate");
+	VarListPtr firstPrivateClause = handleIdentifierList(map, keys::firstprivate);
 	// check for lastprivate clause
-	VarListPtr lastPrivateClause = handleIdentifierList(map, "lastprivate");
+	VarListPtr lastPrivateClause = handleIdentifierList(map, keys::lastprivate);
 	// check for reduction clause
 	ReductionPtr reductionClause = handleReductionClause(map);
 	// check for nowait keyword
-	bool noWait = hasKeyword(map, "nowait");
+	bool noWait = hasKeyword(map, keys::nowait);
 
 	return std::make_shared<Sections>( privateClause, firstPrivateClause, 
 			lastPrivateClause, reductionClause, noWait );
@@ -521,13 +592,13 @@ AnnotationPtr OmpPragmaSection::toAnnotation() const {
 AnnotationPtr OmpPragmaSingle::toAnnotation() const {
 	const MatchMap& map = getMap();
 	// check for private clause
-	VarListPtr privateClause = handleIdentifierList(map, "private");
+	VarListPtr privateClause = handleIdentifierList(map, keys::private_);
 	// check for firstprivate clause
-	VarListPtr firstPrivateClause = handleIdentifierList(map, "firstprivate");
+	VarListPtr firstPrivateClause = handleIdentifierList(map, keys::firstprivate);
 	// check for copyprivate clause
-	VarListPtr copyPrivateClause = handleIdentifierList(map, "copyprivate");
+	VarListPtr copyPrivateClause = handleIdentifierList(map, keys::copyprivate);
 	// check for nowait keyword
-	bool noWait = hasKeyword(map, "nowait");
+	bool noWait = hasKeyword(map, keys::nowait);
 
 	return std::make_shared<Single>( privateClause, firstPrivateClause, 
 			copyPrivateClause, noWait );
@@ -542,17 +613,17 @@ AnnotationPtr OmpPragmaSingle::toAnnotation() const {
 AnnotationPtr OmpPragmaTask::toAnnotation() const {
 	const MatchMap& map = getMap();
 	// check for if clause
-	const clang::Expr*	ifClause = handleSingleExpression(map, "if");
+	const clang::Expr*	ifClause = handleSingleExpression(map, keys::if_);
 	// check for nowait keyword
-	bool untied = hasKeyword(map, "untied");
+	bool untied = hasKeyword(map, keys::untied);
 	// check for default clause
 	DefaultPtr defaultClause = handleDefaultClause(map);
 	// check for private clause
-	VarListPtr privateClause = handleIdentifierList(map, "private");
+	VarListPtr privateClause = handleIdentifierList(map, keys::private_);
 	// check for firstprivate clause
-	VarListPtr firstPrivateClause = handleIdentifierList(map, "firstprivate");
+	VarListPtr firstPrivateClause = handleIdentifierList(map, keys::firstprivate);
 	// check for shared clause
-	VarListPtr sharedClause = handleIdentifierList(map, "shared");
+	VarListPtr sharedClause = handleIdentifierList(map, keys::shared);
 	// We need to check if the
 	return make_shared<Task>( ifClause, 
 				untied, defaultClause, privateClause, 
@@ -569,11 +640,11 @@ AnnotationPtr OmpPragmaCritical::toAnnotation() const {
 
 	std::string name;
 	// checking region name (if existing)
-	auto fit = map.find("critical");
+	auto fit = map.find(keys::critical);
 	if(fit != map.end()) {
 		const ValueList& vars = fit->second;
 		assert(vars.size() == 1 && "Critical region has multiple names");
-		name = *vars.front()->get<std::string*>();
+		name = vars.front().getString().str();
 	}
 
 	return std::make_shared<Critical>( name );
@@ -594,7 +665,7 @@ AnnotationPtr OmpPragmaAtomic::toAnnotation() const {
 
 AnnotationPtr OmpPragmaFlush::toAnnotation() const {
 	// check for flush identifier list
-	VarListPtr flushList = handleIdentifierList(getMap(), "flush");
+	VarListPtr flushList = handleIdentifierList(getMap(), keys::flush);
 	return std::make_shared<Flush>( flushList );
 }
 
@@ -7,8 +7,13 @@
 #include "sema.h"
 #include "handler.h"
 #include "utils/source_locations.h"
+#include "driver/prescan.h"
+#include "utils/stats.h"
 
 #include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/MacroInfo.h"
+#include "clang/Lex/Lexer.h"
 #include "clang/Parse/Parser.h"
 #include "clang/AST/Stmt.h"
 #include "clang/AST/Decl.h"
@@ -16,64 +21,206 @@
 #include "clang/Sema/Sema.h"
 
 #include <iostream>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <tuple>
 
 using namespace clomp;
 using namespace clomp::utils;
 using namespace clang;
 
-typedef std::list<PragmaPtr> PendingPragmaList;
-
 namespace {
 
-// It returns true if the source location SL is inside the range defined by SR
-bool isInsideRange(SourceRange SR, SourceLocation SL, SourceManager const& sm) {
-	return Line(SR, sm).first <= Line(SL, sm) && Line(SR, sm).second > Line(SL, sm);
-}
+typedef Pragma::Position Position;
 
-// It returns true if the source location SL is after the range defined by SR
-bool isAfterRange(SourceRange SR, SourceLocation SL, clang::SourceManager const& sm) {
-	return Line(SR, sm).second <= Line(SL, sm);
-}
+/**
+ * Orders the positions as they appear in the translation unit. Positions within the same
+ * file are compared by offset, the SourceManager is only queried for positions in different 
+ * files. Invalid positions (e.g. of the statements added by clomp) come first.
+ */
+class PositionLess {
+	const SourceManager* sm;
+
+public:
+	PositionLess(const SourceManager& sm): sm(&sm) { }
+
+	bool operator()(const Position& lhs, const Position& rhs) const {
+		if ( lhs.first == rhs.first ) { return lhs.second < rhs.second; }
+		if ( lhs.first.isInvalid() || rhs.first.isInvalid() ) { return lhs.first.isInvalid(); }
+		return sm->isBeforeInTranslationUnit( sm->getComposedLoc(lhs.first, lhs.second), 
+											  sm->getComposedLoc(rhs.first, rhs.second) );
+	}
+};
+
+/**
+ * The pragmas which have not been associated to any node yet, ordered by the position where 
+ * they start (pragmas starting at the same position are kept in the order they were added). 
+ * Range queries and removals take logarithmic time.
+ */
+class PendingPragmas {
+	typedef std::multimap<Position, PragmaPtr, PositionLess> PragmaIndex;
+
+	PragmaIndex index;
+	// position of each pragma in the index, used to remove the matched pragmas
+	std::unordered_map<const Pragma*, PragmaIndex::iterator> positions;
+
+public:
+	typedef PragmaIndex::const_reverse_iterator reverse_iterator;
+	typedef std::pair<reverse_iterator, reverse_iterator> range;
+
+	PendingPragmas(const SourceManager& sm): index(PositionLess(sm)) { }
+
+	void add(const PragmaPtr& P) {
+		positions[P.get()] = index.insert( std::make_pair(P->getStartPosition(), P) );
+	}
+
+	void remove(const PragmaPtr& P) {
+		auto fit = positions.find(P.get());
+		assert(fit != positions.end() && "Current matched pragma is not in the list of pending pragmas");
+		index.erase(fit->second);
+		positions.erase(fit);
+	}
+
+	/**
+	 * Returns the pragmas starting within [first, last), the last one first
+	 */
+	range between(const Position& first, const Position& last) const {
+		if ( !index.key_comp()(first, last) ) { return range(index.rend(), index.rend()); }
+		return range(reverse_iterator(index.lower_bound(last)), reverse_iterator(index.lower_bound(first)));
+	}
+
+	/**
+	 * Returns the pragmas starting before last, the last one first
+	 */
+	range before(const Position& last) const {
+		return range(reverse_iterator(index.lower_bound(last)), index.rend());
+	}
+
+	/**
+	 * Returns true if the location L comes before the position pos
+	 */
+	bool isBefore(SourceLocation L, const Position& pos, const SourceManager& sm) const {
+		return index.key_comp()(sm.getDecomposedExpansionLoc(L), pos);
+	}
 
-void EraseMatchedPragmas(PendingPragmaList& pending, PragmaList& matched) {
-	for ( PragmaList::iterator I = matched.begin(), E = matched.end(); I != E; ++I ) {
-		std::list<PragmaPtr>::iterator it = std::find(pending.begin(), pending.end(), *I);
-		assert(it != pending.end() && "Current matched pragma is not in the list of pending pragmas");
-		pending.erase(it);
+	/**
+	 * Removes all the pragmas and returns them in source order
+	 */
+	PragmaList takeAll() {
+		PragmaList pragmas;
+		pragmas.reserve(index.size());
+		std::for_each(index.begin(), index.end(), [&](const PragmaIndex::value_type& cur) { pragmas.push_back(cur.second); });
+		index.clear();
+		positions.clear();
+		return pragmas;
 	}
-} // end anonymous namespace 
+};
 
 /**
  * Given a range, the PragmaFilter returns the pragmas with are defined between that range.
  */
 class PragmaFilter {
-	SourceRange bounds;
-	SourceManager const& sm;
-	PendingPragmaList::reverse_iterator I, E;
+	PendingPragmas::reverse_iterator I, E;
 
-	void inc(bool first) {
-		while ( first && I != E && isAfterRange(bounds, (*I)->getStartLocation(), sm) )
-			++I;
-		if (!first)	++I;
+public:
+	PragmaFilter(SourceRange const& bounds, SourceManager const& sm, const PendingPragmas& pending) {
+		std::tie(I, E) = pending.between( sm.getDecomposedExpansionLoc(bounds.getBegin()), 
+										  sm.getDecomposedExpansionLoc(bounds.getEnd()) );
+	}
+
+	void operator++() {	++I; }
+
+	PragmaPtr operator*() const { return I == E ? PragmaPtr() : I->second; }
+};
+
+/**
+ * The macros whose expansion can introduce an OpenMP pragma into a function body which 
+ * contains none in its source
+ */
+class PragmaMacros {
+	// macros whose definition contains an _Pragma operator which may be an OpenMP pragma
+	std::set<const IdentifierInfo*> pragmaOps;
+	// macros known to reach (or not) one of the above through their expansion, cleared as 
+	// soon as a macro is defined or undefined
+	std::map<const IdentifierInfo*, bool> expansions;
+
+	bool reaches(const IdentifierInfo* II, Preprocessor& PP, std::set<const IdentifierInfo*>& visited) const {
+		if (!II->hasMacroDefinition() || !visited.insert(II).second) 	{ return false; }
+		if (pragmaOps.count(II)) 										{ return true; }
+
+		auto fit = expansions.find(II);
+		if (fit != expansions.end()) { return fit->second; }
+
+		const MacroInfo* MI = PP.getMacroInfo(const_cast<IdentifierInfo*>(II));
+		if (!MI) { return false; }
+		for (MacroInfo::tokens_iterator I = MI->tokens_begin(), E = MI->tokens_end(); I != E; ++I) {
+			if (I->getIdentifierInfo() && reaches(I->getIdentifierInfo(), PP, visited)) { return true; }
+		}
+		return false;
 	}
 
 public:
-	PragmaFilter(SourceRange const& bounds, SourceManager const& sm, PendingPragmaList& pragma_list) :
-		bounds(bounds), sm(sm), I(pragma_list.rbegin()), E(pragma_list.rend()) { inc(true); }
+	void define(const IdentifierInfo* II, bool hasPragmaOp) {
+		expansions.clear();
+		if (hasPragmaOp) 	{ pragmaOps.insert(II); }
+		else 				{ pragmaOps.erase(II); }
+	}
 
-	void operator++() {	inc(false); }
+	bool empty() const { return pragmaOps.empty(); }
 
-	PragmaPtr operator*() const {
-		if ( I == E ) return PragmaPtr();
+	/**
+	 * Returns true if the expansion of the identifier II may contain an OpenMP pragma
+	 */
+	bool mayExpandToPragma(const IdentifierInfo* II, Preprocessor& PP) {
+		if (!II->hasMacroDefinition()) { return false; }
 
-		if ( isInsideRange(bounds, (*I)->getStartLocation(), sm)) {
-			return *I;
+		auto fit = expansions.find(II);
+		if (fit != expansions.end()) { return fit->second; }
+
+		// only the result of the whole search is stored, the macros it visits may be part of a cycle
+		std::set<const IdentifierInfo*> visited;
+		return expansions[II] = reaches(II, PP, visited);
+	}
+};
+
+/**
+ * Keeps track of the macros whose definition contains an _Pragma operator. As for the pre-scan
+ * (see prescanBuffer), the operators whose argument is a string literal which does not start 
+ * with omp are ignored.
+ */
+class PragmaMacroTracker: public clang::PPCallbacks {
+	Preprocessor& PP;
+	std::shared_ptr<PragmaMacros> macros;
+
+	bool hasOmpPragmaOp(const MacroInfo* MI) const {
+		for (MacroInfo::tokens_iterator I = MI->tokens_begin(), E = MI->tokens_end(); I != E; ++I) {
+			IdentifierInfo* II = I->getIdentifierInfo();
+			if (!II || II->getName() != "_Pragma") { continue; }
+
+			// _Pragma ( string-literal ), any other argument is built by a macro (e.g. _Pragma(#x))
+			if (E - I < 3 || !I[1].is(clang::tok::l_paren) ||
+				!(I[2].is(clang::tok::string_literal) || I[2].is(clang::tok::wide_string_literal))) 
+			{ 
+				return true; 
+			}
+			std::string&& spelling = PP.getSpelling(I[2]);
+			if (mayBeOmpPragmaLiteral(spelling.data(), spelling.data() + spelling.size())) { return true; }
 		}
+		return false;
+	}
 
-		return PragmaPtr();
+public:
+	PragmaMacroTracker(Preprocessor& PP, const std::shared_ptr<PragmaMacros>& macros): PP(PP), macros(macros) { }
+
+	void MacroDefined(const clang::Token& MacroNameTok, const clang::MacroInfo* MI) {
+		macros->define(MacroNameTok.getIdentifierInfo(), hasOmpPragmaOp(MI));
 	}
 
-	bool operator!=(PragmaFilter const& other) const { return I == other.I; }
+	void MacroUndefined(const clang::Token& MacroNameTok, const clang::MacroInfo* MI) {
+		macros->define(MacroNameTok.getIdentifierInfo(), false);
+	}
 };
 
 } // End empty namespace
@@ -82,10 +229,64 @@ namespace clomp {
 
 struct ClompSema::ClompSemaImpl {
 	PragmaList& pragma_list;
-	PendingPragmaList pending_pragma;
+	PendingPragmas pending_pragma;
+	// when set, receives the pragmas instead of pragma_list
+	PragmaConsumer* consumer;
 
-	ClompSemaImpl(PragmaList& pragma_list) :	
-		pragma_list(pragma_list) {	}
+	// function bodies without pragmas are skipped
+	bool skip_bodies;
+	// macros which may expand to an OpenMP pragma
+	std::shared_ptr<PragmaMacros> pragma_macros;
+	// for each file, the sorted offsets where a pragma can enter the token stream
+	std::map<FileID, std::vector<unsigned>> pragma_points;
+
+	ClompSemaImpl(PragmaList& pragma_list, const SourceManager& sm) :	
+		pragma_list(pragma_list), pending_pragma(sm), consumer(NULL), skip_bodies(false), pragma_macros(std::make_shared<PragmaMacros>()) { }
+
+	/*
+	 * Checks whether the function body starting at the brace LBrace contains no pragmas. The
+	 * offsets of the pragmas of the file are compared with the range of the body, which is
+	 * found by raw lexing from the opening brace (up to the next pragma of the file). The body 
+	 * is not skipped if it uses a macro which may expand to an OpenMP pragma.
+	 */
+	bool isSkippable(SourceLocation LBrace, Preprocessor& PP) {
+		if (!LBrace.isFileID()) { return false; }
+
+		SourceManager& sm = PP.getSourceManager();
+		std::pair<FileID, unsigned>&& locInfo = sm.getDecomposedLoc(LBrace);
+		bool invalid = false;
+		llvm::StringRef&& buffer = sm.getBufferData(locInfo.first, &invalid);
+		if (invalid) { return false; }
+
+		auto fit = pragma_points.find(locInfo.first);
+		if (fit == pragma_points.end()) {
+			fit = pragma_points.insert( std::make_pair(locInfo.first, std::vector<unsigned>()) ).first;
+			findPragmaPoints(buffer.begin(), buffer.end(), fit->second);
+		}
+
+		const std::vector<unsigned>& points = fit->second;
+		std::vector<unsigned>::const_iterator next = std::lower_bound(points.begin(), points.end(), locInfo.second);
+		// no pragma follows the opening brace within this file
+		if (next == points.end() && pragma_macros->empty()) { return true; }
+		unsigned limit = next == points.end() ? buffer.size() : *next;
+
+		Lexer lexer(sm.getLocForStartOfFile(locInfo.first), PP.getLangOpts(), 
+					buffer.begin(), buffer.begin() + locInfo.second, buffer.end());
+		Token tok;
+		unsigned depth = 0;
+		while (true) {
+			lexer.LexFromRawLexer(tok);
+			if (tok.is(clang::tok::eof) || sm.getFileOffset(tok.getLocation()) >= limit) { return false; }
+			// conditional directives can unbalance the braces seen by the raw lexer
+			if (tok.is(clang::tok::hash) && tok.isAtStartOfLine()) { return false; }
+			if (tok.is(clang::tok::raw_identifier) && pragma_macros->mayExpandToPragma(PP.LookUpIdentifierInfo(tok), PP)) { 
+				return false; 
+			}
+
+			if (tok.is(clang::tok::l_brace)) { ++depth; }
+			else if (tok.is(clang::tok::r_brace) && --depth == 0) { return true; }
+		}
+	}
 };
 
 ClompSema::ClompSema(PragmaList& 		 pragma_list, 
@@ -96,11 +297,25 @@ ClompSema::ClompSema(PragmaList& 		 pragma_list,
 		   clang::CodeCompleteConsumer*  CompletionConsumer) 
 :
 	clang::Sema(pp, ctx, consumer, clang::TU_Complete, CompletionConsumer),
-	pimpl(new ClompSemaImpl(pragma_list)),
+	pimpl(new ClompSemaImpl(pragma_list, pp.getSourceManager())),
 	isInsideFunctionDef(false) { }
 
 ClompSema::~ClompSema() { delete pimpl; }
 
+void ClompSema::enableBodySkipping() {
+	pimpl->skip_bodies = true;
+	PP.addPPCallbacks( new PragmaMacroTracker(PP, pimpl->pragma_macros) );
+}
+
+void ClompSema::skipBodyIfPragmaFree() {
+	if (!pimpl->skip_bodies) { return; }
+	PhaseTimer timer(&ParseStats::semaTime);
+
+	// a function body is either introduced by '{' or by a ctor initializer / try block
+	Token& tok = ParserProxy::get().CurrentToken();
+	ParserProxy::get().SkipFunctionBodies( tok.is(clang::tok::l_brace) && pimpl->isSkippable(tok.getLocation(), PP) );
+}
+
 /*
  * The function search for the character c in the input stream backwards. The assumption is the
  * character will be in the input stream so no termination condition is needed.
@@ -166,20 +381,22 @@ clang::StmtResult ClompSema::ActOnCompoundStmt(clang::SourceLocation L,
 	}
 
 	StmtResult&& ret = Sema::ActOnCompoundStmt(L, R, std::move(Elts), isStmtExpr);
+	PhaseTimer timer(&ParseStats::semaTime);
 	clang::CompoundStmt* CS = cast<CompoundStmt>(ret.get());
 	Stmt* Prev = NULL;
 
-	PragmaList matched;
+	PragmaList matched, trailing;
 
+	const PendingPragmas& pending = pimpl->pending_pragma;
 	SourceRange SR(CS->getLBracLoc(), CS->getRBracLoc());
-	for ( PragmaFilter&& filter = PragmaFilter(SR, SourceMgr, pimpl->pending_pragma); *filter; ++filter ) {
+	for ( PragmaFilter&& filter = PragmaFilter(SR, SourceMgr, pending); *filter; ++filter ) {
 		PragmaPtr P = *filter;
 		for ( CompoundStmt::reverse_body_iterator I = CS->body_rbegin(), E = CS->body_rend(); I != E; ) {
 			Prev = *I;
 			++I;
 
-			if ( I != E && Line((*I)->getLocStart(), SourceMgr) < Line(P->getEndLocation(), SourceMgr) ) {
-				if ( Line(Prev->getLocStart(), SourceMgr) >= Line(P->getEndLocation(), SourceMgr) ) {
+			if ( I != E && pending.isBefore((*I)->getLocStart(), P->getEndPosition(), SourceMgr) ) {
+				if ( !pending.isBefore(Prev->getLocStart(), P->getEndPosition(), SourceMgr) ) {
 					// set the statement for the current pragma
 					P->setStatement(Prev);
 					// add pragma to the list of matched pragmas
@@ -187,32 +404,13 @@ clang::StmtResult ClompSema::ActOnCompoundStmt(clang::SourceLocation L,
 					break;
 				}
 
-				// add a ';' (NullStmt) before the end of the block in order to associate the pragma
-				Stmt** stmts = new Stmt*[CS->size() + 1];
-
-				CompoundStmt* newCS =
-						new (Context) CompoundStmt(Context, stmts, CS->size()+1, CS->getSourceRange().getBegin(),
-								CS->getSourceRange().getEnd()
-							);
-
-				std::copy(CS->body_begin(), CS->body_end(), newCS->body_begin());
-				std::for_each(CS->body_begin(), CS->body_end(), [&] (Stmt*& curr) { Context.Deallocate(curr); });
-				newCS->setLastStmt( new (Context) NullStmt(SourceLocation()) );
-				P->setStatement( *newCS->body_rbegin() );
+				// the pragma follows the last statement of the block, it is associated to a ';' 
+				// (NullStmt) added once all the pragmas of the block have been examined
+				trailing.push_back(P);
 				matched.push_back(P);
-
-				// transfer the ownership of the statement
-				CompoundStmt* oldStmt = ret.takeAs<CompoundStmt>();
-				oldStmt->setStmts(Context, NULL, 0);
-				ret = newCS;
-				CS = newCS;
-
-				// destroy the old compound stmt
-				Context.Deallocate(oldStmt);
-				delete[] stmts;
 				break;
 			}
-			if ( I == E && Line(Prev->getLocStart(), SourceMgr) > Line(P->getEndLocation(), SourceMgr) ) {
+			if ( I == E && !pending.isBefore(Prev->getLocStart(), P->getEndPosition(), SourceMgr) ) {
 				P->setStatement(Prev);
 				matched.push_back(P);
 				break;
@@ -220,8 +418,19 @@ clang::StmtResult ClompSema::ActOnCompoundStmt(clang::SourceLocation L,
 		}
 	}
 
+	if ( !trailing.empty() ) {
+		// append a NullStmt for each trailing pragma (in source order) with a single rebuild of the body
+		countStat(&ParseStats::compoundRebuilds);
+		std::vector<Stmt*> stmts(CS->body_begin(), CS->body_end());
+		std::for_each(trailing.rbegin(), trailing.rend(), [&](const PragmaPtr& cur) {
+			stmts.push_back( new (Context) NullStmt(SourceLocation()) );
+			cur->setStatement( stmts.back() );
+		});
+		CS->setStmts(Context, stmts.data(), stmts.size());
+	}
+
 	// remove matched pragmas
-	EraseMatchedPragmas(pimpl->pending_pragma, matched);
+	pragmasMatched(matched);
 	return std::move(ret);
 }
 
@@ -246,6 +455,7 @@ clang::StmtResult ClompSema::ActOnIfStmt(clang::SourceLocation IfLoc,
 {
 	clang::StmtResult ret =	Sema::ActOnIfStmt(IfLoc, CondVal, CondVar, 
 							  		std::move(ThenVal), ElseLoc, std::move(ElseVal));
+	PhaseTimer timer(&ParseStats::semaTime);
 
 	IfStmt* ifStmt = cast<IfStmt>( ret.get() );
 	PragmaList matched;
@@ -255,7 +465,7 @@ clang::StmtResult ClompSema::ActOnIfStmt(clang::SourceLocation IfLoc,
 		matchStmt(ifStmt->getThen(), SourceRange(IfLoc, ElseLoc), SourceMgr, matched);
 	}
 
-	EraseMatchedPragmas(pimpl->pending_pragma, matched);
+	pragmasMatched(matched);
 	matched.clear();
 
 	// is there any pragmas to be associated with the 'else' statement of this if?
@@ -267,7 +477,7 @@ clang::StmtResult ClompSema::ActOnIfStmt(clang::SourceLocation IfLoc,
 				 );
 	}
 
-	EraseMatchedPragmas(pimpl->pending_pragma, matched);
+	pragmasMatched(matched);
 	return std::move(ret);
 }
 
@@ -283,13 +493,14 @@ ClompSema::ActOnForStmt(clang::SourceLocation ForLoc,
 {
 	clang::StmtResult ret = Sema::ActOnForStmt(ForLoc, LParenLoc, std::move(First), 
 									Second, SecondVar, Third, RParenLoc, std::move(Body));
+	PhaseTimer timer(&ParseStats::semaTime);
 
 	ForStmt* forStmt = cast<ForStmt>(ret.get());
 	PragmaList matched;
 	if ( !isa<CompoundStmt> (forStmt->getBody()) ) {
 		matchStmt(forStmt->getBody(), forStmt->getSourceRange(), SourceMgr, matched);
 	}
-	EraseMatchedPragmas(pimpl->pending_pragma, matched);
+	pragmasMatched(matched);
 	matched.clear();
 
 	return std::move(ret);
@@ -297,17 +508,23 @@ ClompSema::ActOnForStmt(clang::SourceLocation ForLoc,
 
 clang::Decl* ClompSema::ActOnStartOfFunctionDef(clang::Scope *FnBodyScope, clang::Declarator &D) {
 	isInsideFunctionDef = true;
+	skipBodyIfPragmaFree();
 	return Sema::ActOnStartOfFunctionDef(FnBodyScope, D);
 }
 
 clang::Decl* ClompSema::ActOnStartOfFunctionDef(clang::Scope *FnBodyScope, clang::Decl* D) {
 	isInsideFunctionDef = true;
+	skipBodyIfPragmaFree();
 	return Sema::ActOnStartOfFunctionDef(FnBodyScope, D);
 }
 
 clang::Decl* ClompSema::ActOnFinishFunctionBody(clang::Decl* Decl, clang::Stmt* Body) {
+	// the parser reads the flag outside of function definitions as well (e.g. for the inline 
+	// methods of a class), it must not outlive the body it was set for
+	if (pimpl->skip_bodies) { ParserProxy::get().SkipFunctionBodies(false); }
 
 	clang::Decl* ret = Sema::ActOnFinishFunctionBody(Decl, std::move(Body));
+	PhaseTimer timer(&ParseStats::semaTime);
 	// We are sure all the pragmas inside the function body have been matched
 
 	FunctionDecl* FD = dyn_cast<FunctionDecl>(ret);
@@ -315,18 +532,13 @@ clang::Decl* ClompSema::ActOnFinishFunctionBody(clang::Decl* Decl, clang::Stmt*
 	if (!FD) { return ret; }
 
 	PragmaList matched;
-	std::list<PragmaPtr>::reverse_iterator I = pimpl->pending_pragma.rbegin(), E = pimpl->pending_pragma.rend();
+	PendingPragmas::range&& pragmas = pimpl->pending_pragma.before( SourceMgr.getDecomposedExpansionLoc(FD->getSourceRange().getEnd()) );
 
-	while ( I != E && isAfterRange(FD->getSourceRange(), (*I)->getStartLocation(), SourceMgr) ) {
-		++I;
+	for ( PendingPragmas::reverse_iterator I = pragmas.first, E = pragmas.second; I != E; ++I ) {
+		I->second->setDecl(FD);
+		matched.push_back(I->second);
 	}
-
-	while ( I != E ) {
-		(*I)->setDecl(FD);
-		matched.push_back(*I);
-		++I;
-	}
-	EraseMatchedPragmas(pimpl->pending_pragma, matched);
+	pragmasMatched(matched);
 	isInsideFunctionDef = false;
 	return ret;
 }
@@ -366,6 +578,7 @@ clang::Decl* ClompSema::ActOnDeclarator(clang::Scope *S, clang::Declarator &D) {
 	if ( isInsideFunctionDef ) {
 		return ret;
 	}
+	PhaseTimer timer(&ParseStats::semaTime);
 
 //	DLOG(INFO) << utils::Line(ret->getSourceRange().getBegin(), SourceMgr) << ":" <<
 //				  utils::Column(ret->getSourceRange().getBegin(), SourceMgr) << ", " <<
@@ -373,19 +586,14 @@ clang::Decl* ClompSema::ActOnDeclarator(clang::Scope *S, clang::Declarator &D) {
 //				  utils::Column(ret->getSourceRange().getEnd(), SourceMgr) << std::endl;
 
 	PragmaList matched;
-	std::list<PragmaPtr>::reverse_iterator I = pimpl->pending_pragma.rbegin(), E = pimpl->pending_pragma.rend();
-
-	while ( I != E && isAfterRange(ret->getSourceRange(), (*I)->getStartLocation(), SourceMgr) ) {
-		++I;
-	}
+	PendingPragmas::range&& pragmas = pimpl->pending_pragma.before( SourceMgr.getDecomposedExpansionLoc(ret->getSourceRange().getEnd()) );
 
-	while ( I != E ) {
-		(*I)->setDecl(ret);
-		matched.push_back(*I);
-		++I;
+	for ( PendingPragmas::reverse_iterator I = pragmas.first, E = pragmas.second; I != E; ++I ) {
+		I->second->setDecl(ret);
+		matched.push_back(I->second);
 	}
 
-	EraseMatchedPragmas(pimpl->pending_pragma, matched);
+	pragmasMatched(matched);
 	return ret;
 }
 
@@ -394,24 +602,44 @@ void ClompSema::ActOnTagFinishDefinition(clang::Scope* S,
 										 clang::SourceLocation RBraceLoc) 
 {
 	Sema::ActOnTagFinishDefinition(S, TagDecl, RBraceLoc);
+	PhaseTimer timer(&ParseStats::semaTime);
 	PragmaList matched;
-	std::list<PragmaPtr>::reverse_iterator I = pimpl->pending_pragma.rbegin(), E = pimpl->pending_pragma.rend();
-
-	while ( I != E && isAfterRange(TagDecl->getSourceRange(), (*I)->getStartLocation(), SourceMgr) ) {
-		++I;
-	}
+	PendingPragmas::range&& pragmas = pimpl->pending_pragma.before( SourceMgr.getDecomposedExpansionLoc(TagDecl->getSourceRange().getEnd()) );
 
-	while ( I != E ) {
-		(*I)->setDecl(TagDecl);
-		matched.push_back(*I);
-		++I;
+	for ( PendingPragmas::reverse_iterator I = pragmas.first, E = pragmas.second; I != E; ++I ) {
+		I->second->setDecl(TagDecl);
+		matched.push_back(I->second);
 	}
-	EraseMatchedPragmas(pimpl->pending_pragma, matched);
+	pragmasMatched(matched);
 }
 
 void ClompSema::addPragma(PragmaPtr P) {
-	pimpl->pragma_list.push_back(P);
-	pimpl->pending_pragma.push_back(P);
+	if (!pimpl->consumer) { pimpl->pragma_list.push_back(P); }
+	P->setPositions(SourceMgr);
+	pimpl->pending_pragma.add(P);
+}
+
+void ClompSema::setPragmaConsumer(PragmaConsumer* consumer) {
+	pimpl->consumer = consumer;
+	if (consumer) { consumer->Initialize(Context); }
+}
+
+void ClompSema::pragmasMatched(const PragmaList& matched) {
+	std::for_each(matched.begin(), matched.end(), [&](const PragmaPtr& cur) { pimpl->pending_pragma.remove(cur); });
+	if (!pimpl->consumer) { return; }
+
+	std::for_each(matched.begin(), matched.end(), [&](const PragmaPtr& cur) { 
+		pimpl->consumer->HandlePragma(cur); 
+	});
+}
+
+void ClompSema::flushPendingPragmas() {
+	if (!pimpl->consumer) { return; }
+
+	PragmaList&& pending = pimpl->pending_pragma.takeAll();
+	std::for_each(pending.begin(), pending.end(), [&](const PragmaPtr& cur) { 
+		pimpl->consumer->HandlePragma(cur); 
+	});
 }
 
 void ClompSema::dump() {
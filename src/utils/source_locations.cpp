@@ -5,6 +5,7 @@
 // License. See LICENSE.TXT for details.
 //=============================================================================
 #include "utils/source_locations.h"
+#include "utils/stats.h"
 
 #define __STDC_LIMIT_MACROS
 #define __STDC_CONSTANT_MACROS
@@ -39,6 +40,7 @@ string FileId(SourceLocation const& l, SourceManager const& sm) {
 }
 
 unsigned Line(SourceLocation const& l, SourceManager const& sm) {
+	countStat(&ParseStats::lineLookups);
 	PresumedLoc pl = sm.getPresumedLoc(l);
 	return pl.getLine();
 }
@@ -0,0 +1,89 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+#include "utils/stats.h"
+
+#include <iomanip>
+#include <fstream>
+#include <cstdlib>
+
+namespace clomp {
+
+thread_local ParseStats* ParseStats::currStats = NULL;
+
+ParseStats::ParseStats() :
+	prescanTime(0), setupTime(0), parseTime(0), preprocessTime(0), matchTime(0), semaTime(0),
+	pragmas(0), backtracks(0), lineLookups(0), compoundRebuilds(0) { }
+
+ParseStats& ParseStats::operator+=(const ParseStats& other) {
+	prescanTime 		+= other.prescanTime;
+	setupTime 			+= other.setupTime;
+	parseTime 			+= other.parseTime;
+	preprocessTime 		+= other.preprocessTime;
+	matchTime 			+= other.matchTime;
+	semaTime 			+= other.semaTime;
+	pragmas 			+= other.pragmas;
+	backtracks 			+= other.backtracks;
+	lineLookups 		+= other.lineLookups;
+	compoundRebuilds 	+= other.compoundRebuilds;
+	return *this;
+}
+
+std::ostream& ParseStats::printTo(std::ostream& out) const {
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+
+	out << std::fixed << std::setprecision(3)
+		<< "setup " 		<< setupTime * 1e3 		<< " ms, "
+		<< "prescan " 		<< prescanTime * 1e3 	<< " ms, "
+		<< "parse " 		<< parseTime * 1e3 		<< " ms, "
+		<< "preprocess " 	<< preprocessTime * 1e3 << " ms, "
+		<< "match " 		<< matchTime * 1e3 		<< " ms, "
+		<< "sema " 			<< semaTime * 1e3 		<< " ms, "
+		<< "pragmas " 		<< pragmas 				<< ", "
+		<< "backtracks " 	<< backtracks 			<< ", "
+		<< "line lookups " 	<< lineLookups 			<< ", "
+		<< "compound rebuilds " << compoundRebuilds;
+
+	out.flags(flags);
+	out.precision(precision);
+	return out;
+}
+
+MemoryStats::MemoryStats() : 
+	astBytes(0), matchBytes(0), pragmaBytes(0), peakRSSDelta(0), retainedRSSDelta(0) { }
+
+std::ostream& MemoryStats::printTo(std::ostream& out) const {
+	return out 
+		<< "ast " 			<< astBytes / 1024 		<< " KiB, "
+		<< "match maps " 	<< matchBytes / 1024 	<< " KiB, "
+		<< "pragmas " 		<< pragmaBytes / 1024 	<< " KiB, "
+		<< "peak RSS +" 	<< peakRSSDelta / 1024 	<< " KiB, "
+		<< "retained RSS +" << retainedRSSDelta / 1024 << " KiB";
+}
+
+MemoryUsage MemoryUsage::current() {
+	MemoryUsage usage = { 0, 0 };
+
+	// lines have the form "VmRSS:	    1234 kB"
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line)) {
+		size_t* field = NULL;
+		if (line.compare(0, 6, "VmRSS:") == 0) 		{ field = &usage.rss; }
+		else if (line.compare(0, 6, "VmHWM:") == 0) { field = &usage.peakRSS; }
+		if (field) { *field = strtoul(line.c_str() + 6, NULL, 10) * 1024; }
+	}
+	return usage;
+}
+
+bool MemoryUsage::resetPeak() {
+	// supported since Linux 4.0
+	std::ofstream clearRefs("/proc/self/clear_refs");
+	return clearRefs && (clearRefs << "5").flush();
+}
+
+} // end clomp namespace
@@ -0,0 +1,11 @@
+
+#include <stdio.h>
+
+int main() {
+	int a = 0;
+	#pragma unroll
+	for(int i=0;i<10;i++) {
+		a += i;
+	}
+	printf("%d\n", a);
+}
@@ -0,0 +1,31 @@
+
+int init(int* v, int n) {
+	for(int i=0;i<n;i++) {
+		if (i % 2) { v[i] = i; } else { v[i] = -i; }
+	}
+	return n;
+}
+
+void kernel(int* v, int n) {
+	int s = 0;
+	#pragma omp parallel for reduction(+:s)
+	for(int i=0;i<n;i++) {
+		s += v[i];
+	}
+	v[0] = s;
+}
+
+int sum(int* v, int n) {
+	int s = 0;
+	for(int i=0;i<n;i++) { s += v[i]; }
+	return s;
+}
+
+int main() {
+	int v[100];
+	init(v, 100);
+	#pragma omp task
+	kernel(v, 100);
+	#pragma omp taskwait
+	return sum(v, 100);
+}
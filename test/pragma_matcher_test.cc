@@ -13,11 +13,14 @@
 #include "utils/config.h"
 
 #include "handler.h"
+#include "grammar.h"
 #include "omp/pragma.h"
 
 #include "clang/AST/Expr.h"
 #include "clang/AST/Type.h"
 
+#include <type_traits>
+
 using namespace clomp;
 
 #define CHECK_LOCATION(loc, srcMgr, line, col) \
@@ -90,14 +93,14 @@ TEST(PragmaMatcherTest, HandleOmpParallel) {
 
 		// check first variable name
 		{
-			clang::DeclRefExpr* varRef =  llvm::dyn_cast<clang::DeclRefExpr>(values[0]->get<clang::Stmt*>());
+			clang::DeclRefExpr* varRef =  llvm::dyn_cast<clang::DeclRefExpr>(values[0].getStmt());
 			ASSERT_TRUE(varRef);
 			// ASSERT_EQ(varRef->getDecl()->getNameAsString(), "a");
 		}
 
 		// check second variable name
 		{
-			clang::DeclRefExpr* varRef = llvm::dyn_cast<clang::DeclRefExpr>(values[1]->get<clang::Stmt*>());
+			clang::DeclRefExpr* varRef = llvm::dyn_cast<clang::DeclRefExpr>(values[1].getStmt());
 			ASSERT_TRUE(varRef);
 			ASSERT_EQ(varRef->getDecl()->getNameAsString(), "b");
 		}
@@ -106,7 +109,7 @@ TEST(PragmaMatcherTest, HandleOmpParallel) {
 		auto dit = omp->getMap().find("default");
 		EXPECT_TRUE(dit != omp->getMap().end());
 		EXPECT_FALSE(dit->second.empty());
-		EXPECT_EQ(*dit->second[0]->get<std::string*>(), "shared");
+		EXPECT_EQ(dit->second[0].getString(), "shared");
 	}
 
 	p = pl[2];
@@ -203,7 +206,7 @@ TEST(PragmaMatcherTest, HandleOmpFor) {
 
 		// check first variable name
 		{
-			clang::DeclRefExpr* varRef = llvm::dyn_cast<clang::DeclRefExpr>(values[0]->get<clang::Stmt*>());
+			clang::DeclRefExpr* varRef = llvm::dyn_cast<clang::DeclRefExpr>(values[0].getStmt());
 			ASSERT_TRUE(varRef);
 			ASSERT_EQ(varRef->getDecl()->getNameAsString(), "a");
 		}
@@ -263,7 +266,7 @@ TEST(PragmaMatcherTest, HandleOmpFor) {
 
 		// check first variable name
 		{
-			clang::DeclRefExpr* varRef =  llvm::dyn_cast<clang::DeclRefExpr>(values[0]->get<clang::Stmt*>());
+			clang::DeclRefExpr* varRef =  llvm::dyn_cast<clang::DeclRefExpr>(values[0].getStmt());
 			ASSERT_TRUE(varRef);
 			ASSERT_EQ(varRef->getDecl()->getNameAsString(), "a");
 		}
@@ -296,3 +299,177 @@ TEST(PragmaMatcherTest, HandleOmpFor) {
 	}
 
 }
+
+TEST(PragmaMatcherTest, FirstSets) {
+	using namespace clomp::tok;
+
+	auto clause = (kwd("private") >> l_paren >> var >> r_paren) | kwd("nowait") | (!comma >> kwd("shared"));
+
+	FirstSet&& first = clause.getFirst();
+	EXPECT_EQ(first.keywords, std::set<std::string>({ "private", "nowait", "shared" }));
+	EXPECT_EQ(first.tokens.size(), (size_t) 1);
+	EXPECT_EQ(first.tokens.count(clang::tok::comma), (size_t) 1);
+	EXPECT_FALSE(first.anyIdentifier);
+	EXPECT_FALSE(first.nullable);
+
+	// optional and repeated nodes can match nothing, the following node starts the match
+	EXPECT_TRUE( (!clause).getFirst().nullable );
+	EXPECT_EQ( (*comma >> var).getFirst().tokens.count(clang::tok::comma), (size_t) 1 );
+	EXPECT_TRUE( (*comma >> var).getFirst().anyIdentifier );
+
+	// the tokens starting an expression are not known
+	EXPECT_TRUE( (expr >> r_paren).getFirst().anyToken );
+}
+
+TEST(PragmaMatcherTest, ClauseDispatch) {
+
+	// the clauses of a pragma are matched whatever their order
+	const std::string code = 
+		"void f(int n, int* a) {\n"
+		"	int i, x, y;\n"
+		"	#pragma omp parallel for nowait reduction(+: x) schedule(dynamic, 4) private(i, y) num_threads(4)\n"
+		"	for (i = 0; i < n; ++i) a[i] = i;\n"
+		"}\n";
+
+	TranslationUnit tu(VirtualFile("dispatch.c", code));
+	ASSERT_EQ(tu.getPragmaList().size(), (size_t) 1);
+
+	const MatchMap& map = static_cast<omp::OmpPragma*>(tu.getPragmaList().front().get())->getMap();
+	const char* keys[] = { "for", "nowait", "reduction", "reduction_op", "schedule", "chunk_size", "private", "num_threads" };
+	for (unsigned i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+		EXPECT_EQ(map.count(keys[i]), (size_t) 1) << keys[i];
+	}
+	EXPECT_EQ(map.find("private")->second.size(), (size_t) 2);
+}
+
+TEST(PragmaMatcherTest, MatchKeys) {
+
+	MatchKey privKey = MatchKeyRegistry::get("private");
+	EXPECT_EQ(MatchKeyRegistry::get("private"), privKey);
+	EXPECT_EQ(MatchKeyRegistry::lookup("private"), privKey);
+	EXPECT_EQ(MatchKeyRegistry::getName(privKey), "private");
+	EXPECT_EQ(MatchKeyRegistry::lookup("no_such_key"), MatchKeyRegistry::NoKey);
+
+	// the entries are kept in the order in which the keys are matched
+	MatchMap mmap;
+	mmap[MatchKeyRegistry::get("nowait")];
+	mmap[privKey].push_back( ValueUnion("a") );
+	mmap[privKey].push_back( ValueUnion("b") );
+
+	EXPECT_EQ(mmap.size(), (size_t) 2);
+	EXPECT_EQ(MatchMap::getKeyName(mmap.begin()->first), "nowait");
+	EXPECT_EQ(mmap.find(privKey)->second.size(), (size_t) 2);
+	EXPECT_EQ(mmap.count("nowait"), (size_t) 1);
+	EXPECT_TRUE(mmap.find("no_such_key") == mmap.end());
+
+	MatchMap moved(std::move(mmap));
+	EXPECT_TRUE(mmap.empty());
+	EXPECT_TRUE(mmap.find(privKey) == mmap.end());
+	EXPECT_EQ(moved.find(privKey)->second.size(), (size_t) 2);
+	EXPECT_EQ(moved.find(privKey)->second.back().toStr(), "b");
+}
+
+TEST(PragmaMatcherTest, InlineValues) {
+
+	const std::string code = 
+		"void f(int n, int* a) {\n"
+		"	int i;\n"
+		"	#pragma omp for private(i) schedule(static) nowait\n"
+		"	for (i = 0; i < n; ++i) a[i] = i;\n"
+		"}\n";
+
+	TranslationUnit tu(VirtualFile("inline.c", code));
+	ASSERT_EQ(tu.getPragmaList().size(), (size_t) 1);
+
+	const MatchMap& map = static_cast<omp::OmpPragma*>(tu.getPragmaList().front().get())->getMap();
+	EXPECT_EQ(map.size(), (size_t) 3);
+	EXPECT_TRUE(map.find("private")->second[0].isStmt());
+	// keywords are spelled as written in the source
+	EXPECT_EQ(map.find("schedule")->second[0].getString(), "static");
+
+	// few single valued clauses are stored without heap allocations
+	EXPECT_EQ(map.getAllocatedSize(), (size_t) 0);
+}
+
+TEST(PragmaMatcherTest, InvalidPragma) {
+
+	// nothing is recorded until recording is started
+	ParserStack errStack;
+	errStack.addExpected(errStack.openRecord(), ParserStack::Error("'x'", clang::SourceLocation()));
+	EXPECT_EQ(errStack.stackSize(), (size_t) 0);
+
+	errStack.startRecording();
+	size_t id = errStack.openRecord();
+	errStack.addExpected(id, ParserStack::Error("'x'", clang::SourceLocation()));
+	EXPECT_EQ(errStack.getRecord(id).size(), (size_t) 1);
+
+	// a pragma which cannot be matched is matched again to report the expected tokens
+	const std::string code = 
+		"void f(int n) {\n"
+		"	int i;\n"
+		"	#pragma omp parallel private(i\n"
+		"	{ }\n"
+		"}\n";
+
+	// the error is reported once, listing the tokens expected at the end of the directive (3:32)
+	auto checkReport = [](const std::string& diags) {
+		const std::string report = "invalid.c:3:2: error: expected at location (3:32) ";
+		size_t pos = diags.find(report);
+		ASSERT_NE(pos, std::string::npos) << diags;
+		EXPECT_EQ(diags.find(report, pos+1), std::string::npos) << diags;
+		EXPECT_NE(diags.find("')'", pos), std::string::npos) << diags;
+	};
+
+	testing::internal::CaptureStderr();
+	EXPECT_THROW( { TranslationUnit tu(VirtualFile("invalid.c", code)); }, ClangParsingError );
+	checkReport(testing::internal::GetCapturedStderr());
+
+	testing::internal::CaptureStderr();
+	EXPECT_THROW( collectPragmas(VirtualFile("invalid.c", code)), ClangParsingError );
+	checkReport(testing::internal::GetCapturedStderr());
+}
+
+TEST(PragmaMatcherTest, StaticGrammar) {
+	using namespace clomp::grammar::tok;
+	using grammar::kwd;
+	using grammar::Tok;
+
+	// the operators build the type of the grammar
+	auto clause = kwd("private") >> l_paren >> var["private"] >> r_paren;
+	EXPECT_TRUE( (std::is_same<decltype(kwd("nowait") | comma), grammar::choice<kwd, Tok<clang::tok::comma>>>::value) );
+	EXPECT_TRUE( (std::is_same<decltype(!clause), grammar::option<decltype(clause)>>::value) );
+	EXPECT_TRUE( (std::is_same<decltype(*clause), grammar::star<decltype(clause)>>::value) );
+	EXPECT_EQ(MatchKeyRegistry::lookup("private"), clause.first.second.key);
+	// an empty name assigns no key, as for the runtime nodes
+	EXPECT_EQ(MatchKeyRegistry::NoKey, clause[""].first.second.key);
+	EXPECT_EQ(MatchKeyRegistry::lookup(""), MatchKeyRegistry::NoKey);
+
+	clang::Token token;
+	token.startToken();
+	token.setKind(clang::tok::comma);
+	EXPECT_FALSE( clause.mayStartWith(token) );
+	EXPECT_TRUE( (!comma >> clause).mayStartWith(token) );
+	EXPECT_TRUE( (clause | ~comma).mayStartWith(token) );
+	EXPECT_TRUE( (expr >> r_paren).mayStartWith(token) );
+
+	// the alternatives of a chain of choices are selected by a table shared with the runtime matcher
+	auto clauses = kwd("nowait") | clause | ~comma;
+	ASSERT_EQ(clauses.table->size(), (size_t) 3);
+	ASSERT_EQ(clauses.table->getCandidates(token).size(), (size_t) 1);
+	EXPECT_EQ(clauses.table->getCandidates(token).front(), 2u);
+	EXPECT_EQ(clauses["clause"].table, clauses.table);
+	token.setKind(clang::tok::l_paren);
+	EXPECT_FALSE( clauses.mayStartWith(token) );
+	EXPECT_TRUE( clauses.getFirst().keywords.count("private") );
+
+	// the grammar is wrapped into a node of the runtime matcher
+	std::shared_ptr<node> rule = grammar::makeRule(!(clause >> *(!comma >> clause)) >> eod);
+	ASSERT_TRUE( static_cast<bool>(rule) );
+	std::unique_ptr<node> copy( rule->copy() );
+	EXPECT_TRUE( copy.get() != NULL );
+	// the FIRST set of the rule is available to the runtime choices
+	const FirstSet& first = rule->getFirst();
+	EXPECT_TRUE( first.keywords.count("private") );
+	EXPECT_TRUE( first.tokens.count(clang::tok::eod) );
+	EXPECT_FALSE( first.nullable );
+}
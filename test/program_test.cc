@@ -0,0 +1,850 @@
+//=============================================================================
+//               	Clomp: A Clang-based OpenMP Frontend
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//=============================================================================
+
+#include <gtest/gtest.h>
+
+#include "driver/program.h"
+#include "driver/prescan.h"
+#include "driver/cache.h"
+#include "driver/compilation_db.h"
+#include "driver/batch.h"
+#include "driver/index.h"
+#include "driver/server.h"
+#include "utils/config.h"
+
+#include "handler.h"
+#include "omp/pragma.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace clomp;
+
+TEST(ProgramTest, ConcurrentTranslationUnits) {
+
+	std::vector<std::string> files;
+	files.push_back( std::string(SRC_DIR) + "/inputs/omp_parallel.c" );
+	files.push_back( std::string(SRC_DIR) + "/inputs/omp_for.c" );
+	files.push_back( std::string(SRC_DIR) + "/inputs/omp_parallel.c" );
+	files.push_back( std::string(SRC_DIR) + "/inputs/omp_for.c" );
+
+	Program prog;
+	std::vector<TranslationUnitPtr> tus = prog.addTranslationUnits(files, CompilerOptions(), 4);
+
+	ASSERT_EQ(tus.size(), files.size());
+	EXPECT_EQ(prog.getTranslationUnits().size(), files.size());
+
+	// translation units are returned in the order of the input files
+	for (size_t i = 0; i < files.size(); ++i) {
+		ASSERT_TRUE(static_cast<bool>(tus[i]));
+		EXPECT_EQ(tus[i]->getFileName(), files[i]);
+		EXPECT_EQ(tus[i]->getPragmaList().size(), (size_t) 4);
+	}
+
+	// every pragma must be associated to a node of its own translation unit
+	for (auto it = prog.pragmas_begin(), end = prog.pragmas_end(); it != end; ++it) {
+		PragmaPtr p = (*it).first;
+		EXPECT_TRUE(p->isStatement() || p->isDecl());
+	}
+
+	// the options are used for every file of the list
+	CompilerOptions opts;
+	opts.detach = true;
+	opts.collectStats = true;
+
+	Program detached;
+	tus = detached.addTranslationUnits(files, opts, 2);
+	ASSERT_EQ(tus.size(), files.size());
+	for (size_t i = 0; i < files.size(); ++i) {
+		ASSERT_TRUE(static_cast<bool>(tus[i]));
+		EXPECT_TRUE(tus[i]->isDetached());
+		EXPECT_EQ(tus[i]->getPragmaInfos().size(), (size_t) 4);
+		EXPECT_EQ(tus[i]->getStats().pragmas, 4u);
+	}
+}
+
+TEST(PrescanTest, Buffer) {
+
+	auto scan = [](const std::string& code, std::vector<PrescanInclude>& includes) -> bool {
+		return prescanBuffer(code.data(), code.data() + code.size(), includes);
+	};
+
+	std::vector<PrescanInclude> includes;
+	EXPECT_TRUE( scan("int a;\n  #  pragma omp parallel\n", includes) );
+	EXPECT_TRUE( scan("#pragma \\\n omp barrier\n", includes) );
+	EXPECT_TRUE( scan("_Pragma(\"omp barrier\")", includes) );
+	// the argument of _Pragma is built by a macro
+	EXPECT_TRUE( scan("_Pragma(STR(omp barrier))", includes) );
+	// include whose file name is given by a macro
+	EXPECT_TRUE( scan("#include HEADER\n", includes) );
+
+	EXPECT_FALSE( scan("#pragma once\nint ompx; // #pragma omp\n", includes) );
+	EXPECT_FALSE( scan("#pragma ompx\n_Pragma(\"once\")\n", includes) );
+
+	includes.clear();
+	EXPECT_FALSE( scan("#include \"a.h\"\n# include <b.h>\nint a;\n", includes) );
+	ASSERT_EQ(includes.size(), (size_t) 2);
+	EXPECT_EQ(includes[0].name, "a.h");
+	EXPECT_FALSE(includes[0].angled);
+	EXPECT_EQ(includes[1].name, "b.h");
+	EXPECT_TRUE(includes[1].angled);
+}
+
+TEST(PrescanTest, SkipTranslationUnit) {
+
+	CompilerOptions opts;
+	opts.prescan = true;
+
+	EXPECT_FALSE( mayContainOmpPragmas(std::string(SRC_DIR) + "/inputs/no_omp.c", opts) );
+	EXPECT_TRUE( mayContainOmpPragmas(std::string(SRC_DIR) + "/inputs/omp_for.c", opts) );
+
+	Program prog;
+	TranslationUnit& tu = prog.addTranslationUnit(std::string(SRC_DIR) + "/inputs/no_omp.c", opts);
+	EXPECT_TRUE(tu.getPragmaList().empty());
+	// the compiler is not even set up for a skipped translation unit
+	EXPECT_TRUE(tu.isDetached());
+	EXPECT_TRUE(tu.getPragmaInfos().empty());
+	EXPECT_FALSE(tu.getDependencies().empty());
+
+	// pragmas are still found when the pre-scan is enabled
+	TranslationUnit& omp = prog.addTranslationUnit(std::string(SRC_DIR) + "/inputs/omp_for.c", opts);
+	EXPECT_EQ(omp.getPragmaList().size(), (size_t) 4);
+}
+
+TEST(PrescanTest, Includes) {
+
+	char tmpl[] = "/tmp/clomp_prescan_XXXXXX";
+	ASSERT_TRUE( mkdtemp(tmpl) != NULL );
+	const std::string dir(tmpl);
+	ASSERT_EQ( mkdir((dir + "/sys").c_str(), 0755), 0 );
+
+	std::ofstream(dir + "/sys/kernel.h") << "static inline void sync() {\n\t#pragma omp barrier\n}\n";
+	std::ofstream(dir + "/main.c") << "#include <stdio.h>\n#include <kernel.h>\nint main() { sync(); return 0; }\n";
+
+	// the pragma of a header found through the system include paths is not missed
+	CompilerOptions opts;
+	opts.prescan = true;
+	opts.systemIncludePaths.push_back(dir + "/sys");
+	EXPECT_TRUE( mayContainOmpPragmas(dir + "/main.c", opts) );
+
+	Program prog;
+	EXPECT_EQ( prog.addTranslationUnit(dir + "/main.c", opts).getPragmaList().size(), (size_t) 1 );
+
+	// angled includes not found are headers of the default system directories
+	std::ofstream(dir + "/plain.c") << "#include <stdio.h>\nint main() { return 0; }\n";
+	EXPECT_FALSE( mayContainOmpPragmas(dir + "/plain.c", opts) );
+
+	// a quoted include which cannot be resolved may still be found by the compiler
+	std::ofstream(dir + "/missing.c") << "#include \"missing.h\"\nint main() { return 0; }\n";
+	EXPECT_TRUE( mayContainOmpPragmas(dir + "/missing.c", opts) );
+}
+
+namespace {
+
+// returns the last declaration of the function (or method) with the given name
+const clang::FunctionDecl* findFunction(const TranslationUnit& tu, const std::string& name) {
+	const clang::FunctionDecl* ret = NULL;
+	std::function<void (const clang::DeclContext*)> visit = [&](const clang::DeclContext* DC) {
+		for (auto it = DC->decls_begin(), end = DC->decls_end(); it != end; ++it) {
+			if (const clang::FunctionDecl* FD = llvm::dyn_cast<clang::FunctionDecl>(*it)) {
+				if (FD->getNameAsString() == name) { ret = FD; }
+			} else if (const clang::RecordDecl* RD = llvm::dyn_cast<clang::RecordDecl>(*it)) {
+				visit(RD);
+			}
+		}
+	};
+	visit(tu.getCompiler().getASTContext().getTranslationUnitDecl());
+	return ret;
+}
+
+bool hasBody(const TranslationUnit& tu, const std::string& name) {
+	const clang::FunctionDecl* FD = findFunction(tu, name);
+	EXPECT_TRUE(FD != NULL) << name;
+	return FD && FD->getBody();
+}
+
+} // end anonymous namespace
+
+TEST(ProgramTest, SkipFunctionBodies) {
+
+	CompilerOptions opts;
+	opts.skipFunctionBodies = true;
+
+	Program prog;
+	TranslationUnit& tu = prog.addTranslationUnit(std::string(SRC_DIR) + "/inputs/omp_kernels.c", opts);
+
+	// bodies without pragmas are skipped, the others are fully parsed
+	const PragmaList& pl = tu.getPragmaList();
+	ASSERT_EQ(pl.size(), (size_t) 3);
+	for (auto it = pl.begin(), end = pl.end(); it != end; ++it) {
+		EXPECT_TRUE((*it)->isStatement());
+	}
+	EXPECT_FALSE( hasBody(tu, "init") );
+	EXPECT_FALSE( hasBody(tu, "sum") );
+	EXPECT_TRUE( hasBody(tu, "kernel") );
+	EXPECT_TRUE( hasBody(tu, "main") );
+
+	// the macros defined by the system headers do not prevent the skipping, unless a body 
+	// uses one which expands to an OpenMP pragma
+	TranslationUnit sys(VirtualFile("skip_sys.c", 
+		"#include <stdio.h>\n"
+		"#define BARRIER _Pragma(\"omp barrier\")\n"
+		"#define SYNC() BARRIER\n"
+		"void hello(void) { printf(\"hello\\n\"); }\n"
+		"void publish(int* a) {\n"
+		"	a[0] = 1;\n"
+		"	SYNC();\n"
+		"}\n"
+		"void work(int* a, int n) {\n"
+		"	int i;\n"
+		"	#pragma omp parallel for\n"
+		"	for (i = 0; i < n; ++i) a[i] = i;\n"
+		"}\n"), opts);
+
+	EXPECT_FALSE( hasBody(sys, "hello") );
+	EXPECT_TRUE( hasBody(sys, "publish") );
+	EXPECT_TRUE( hasBody(sys, "work") );
+	EXPECT_EQ(sys.getPragmaList().size(), (size_t) 2);
+
+	// the flag set for a skipped body does not leak into the inline methods of a class, 
+	// which the parser checks before any function definition is started
+	TranslationUnit cpp(VirtualFile("skip_methods.cpp", 
+		"int twice(int x) { return 2 * x; }\n"
+		"struct A {\n"
+		"	int get() const { return v; }\n"
+		"	int v;\n"
+		"};\n"
+		"void fill(const A& a, int* p) {\n"
+		"	#pragma omp parallel\n"
+		"	p[0] = a.get();\n"
+		"}\n"), opts);
+
+	EXPECT_FALSE( hasBody(cpp, "twice") );
+	EXPECT_TRUE( hasBody(cpp, "get") );
+	EXPECT_TRUE( hasBody(cpp, "fill") );
+	ASSERT_EQ(cpp.getPragmaList().size(), (size_t) 1);
+	EXPECT_TRUE(cpp.getPragmaList().front()->isStatement());
+}
+
+TEST(ProgramTest, PragmaInventory) {
+
+	PragmaInfoList&& inventory = collectPragmas(std::string(SRC_DIR) + "/inputs/omp_for.c");
+	ASSERT_EQ(inventory.size(), (size_t) 4);
+
+	// #pragma omp parallel for private(a)
+	EXPECT_EQ(inventory[0].getType(), "omp::parallel");
+	EXPECT_EQ(inventory[0].getLine(), 6u);
+	EXPECT_EQ(inventory[0].getClauses().count("for"), (size_t) 1);
+	ASSERT_EQ(inventory[0].getClauses().count("private"), (size_t) 1);
+	EXPECT_EQ(inventory[0].getClauses().find("private")->second, std::vector<std::string>(1, "a"));
+
+	// #pragma omp for firstprivate(a) nowait
+	EXPECT_EQ(inventory[2].getType(), "omp::for");
+	EXPECT_EQ(inventory[2].getClauses().count("nowait"), (size_t) 1);
+
+	EXPECT_EQ(inventory[3].getType(), "omp::barrier");
+}
+
+TEST(ProgramTest, VirtualFiles) {
+
+	// the files do not exist, the directory (used to resolve quoted includes) does
+	const std::string dir = std::string(SRC_DIR) + "/inputs/";
+	CompilerOptions opts;
+	opts.prescan = true;
+	opts.virtualFiles.push_back( VirtualFile(dir + "generated.h", 
+		"#define N 100\n"
+		"void work(int i);\n"
+		"static inline void barrier() {\n"
+		"	#pragma omp barrier\n"
+		"}\n") );
+
+	VirtualFile input(dir + "generated.c", 
+		"#include \"generated.h\"\n"
+		"int main() {\n"
+		"	#pragma omp parallel for\n"
+		"	for (int i = 0; i < N; ++i) { work(i); }\n"
+		"	return 0;\n"
+		"}\n");
+
+	EXPECT_TRUE( mayContainOmpPragmas(input, opts) );
+
+	Program prog;
+	TranslationUnit& tu = prog.addTranslationUnit(input, opts);
+	EXPECT_EQ(tu.getFileName(), input.name);
+	EXPECT_EQ(tu.getPragmaList().size(), (size_t) 2);
+
+	PragmaInfoList&& inventory = collectPragmas(input, opts);
+	ASSERT_EQ(inventory.size(), (size_t) 2);
+	EXPECT_EQ(inventory[0].getType(), "omp::barrier");
+	EXPECT_EQ(inventory[0].getFileName(), dir + "generated.h");
+	EXPECT_EQ(inventory[1].getType(), "omp::parallel");
+	EXPECT_EQ(inventory[1].getLine(), 3u);
+
+	// a header without pragmas shadowing the one on disk
+	CompilerOptions none;
+	none.virtualFiles.push_back( VirtualFile(dir + "generated.h", "void work(int i);\n") );
+	EXPECT_FALSE( mayContainOmpPragmas(VirtualFile(dir + "generated.c", "#include \"generated.h\"\n"), none) );
+}
+
+TEST(ResultCacheTest, Dependencies) {
+
+	char tmpl[] = "/tmp/clomp_cache_XXXXXX";
+	ASSERT_TRUE( mkdtemp(tmpl) != NULL );
+	const std::string dir(tmpl);
+
+	std::ofstream(dir + "/kernel.h") << "static inline void sync() {\n\t#pragma omp barrier\n}\n";
+	std::ofstream(dir + "/main.c") << "#include \"kernel.h\"\nint main() { sync(); return 0; }\n";
+
+	Program prog;
+	TranslationUnit& tu = prog.addTranslationUnit(dir + "/main.c");
+	const std::vector<FileDependency>& deps = tu.getDependencies();
+	auto hasDependency = [&](const std::string& name) {
+		return std::find_if(deps.begin(), deps.end(), [&](const FileDependency& cur) { return cur.name == name; }) != deps.end();
+	};
+	EXPECT_TRUE( hasDependency(dir + "/main.c") );
+	EXPECT_TRUE( hasDependency(dir + "/kernel.h") );
+
+	ResultCache cache(dir + "/cache");
+	const std::string&& key = ResultCache::makeKey("pragmas", dir + "/main.c", CompilerOptions());
+	std::string output;
+	EXPECT_FALSE( cache.lookup(key, output) );
+	EXPECT_TRUE( cache.store(key, deps, "1 OpenMP pragmas\n") );
+	EXPECT_TRUE( cache.lookup(key, output) );
+	EXPECT_EQ(output, "1 OpenMP pragmas\n");
+
+	// different options produce a different key
+	CompilerOptions opts;
+	opts.definitions.push_back("N=10");
+	EXPECT_FALSE( cache.lookup(ResultCache::makeKey("pragmas", dir + "/main.c", opts), output) );
+
+	// editing the header invalidates the result
+	std::ofstream(dir + "/kernel.h", std::ios::app) << "void work();\n";
+	EXPECT_FALSE( cache.lookup(key, output) );
+
+	// the dependencies are hashed as they were parsed: a result built before the header
+	// changed is never returned
+	EXPECT_TRUE( cache.store(key, deps, "1 OpenMP pragmas\n") );
+	EXPECT_FALSE( cache.lookup(key, output) );
+}
+
+TEST(ResultCacheTest, TranslationUnit) {
+
+	char tmpl[] = "/tmp/clomp_cache_XXXXXX";
+	ASSERT_TRUE( mkdtemp(tmpl) != NULL );
+	const std::string dir(tmpl);
+
+	std::ofstream(dir + "/kernel.h") << "static inline void sync() {\n\t#pragma omp barrier\n}\n";
+	std::ofstream(dir + "/main.c") << 
+		"#include \"kernel.h\"\n"
+		"int main() {\n"
+		"	int i, s = 0;\n"
+		"	#pragma omp parallel for private(i) reduction(+: s)\n"
+		"	for (i = 0; i < 10; ++i) s += i;\n"
+		"	sync();\n"
+		"	return s;\n"
+		"}\n";
+
+	CompilerOptions opts;
+	opts.detach = true;
+	opts.cache = std::make_shared<ResultCache>(dir + "/cache");
+
+	TranslationUnit first(dir + "/main.c", opts);
+	EXPECT_FALSE(first.isCached());
+	ASSERT_EQ(first.getPragmaInfos().size(), (size_t) 2);
+
+	// the pragmas are read back from the cache, the file is not parsed
+	TranslationUnit second(dir + "/main.c", opts);
+	EXPECT_TRUE(second.isCached());
+	EXPECT_TRUE(second.isDetached());
+	ASSERT_EQ(second.getPragmaInfos().size(), (size_t) 2);
+	for (size_t i = 0; i < 2; ++i) {
+		const PragmaInfo& parsed = first.getPragmaInfos()[i];
+		const PragmaInfo& cached = second.getPragmaInfos()[i];
+		EXPECT_EQ(cached.getType(), parsed.getType());
+		EXPECT_EQ(cached.getFileName(), parsed.getFileName());
+		EXPECT_EQ(cached.getLine(), parsed.getLine());
+		EXPECT_EQ(cached.getColumn(), parsed.getColumn());
+		EXPECT_EQ(cached.getStartOffset(), parsed.getStartOffset());
+		EXPECT_EQ(cached.getTargetKind(), parsed.getTargetKind());
+		EXPECT_EQ(cached.getTargetEnd(), parsed.getTargetEnd());
+		EXPECT_EQ(cached.getClauses(), parsed.getClauses());
+		EXPECT_EQ(cached.getValueKinds(), parsed.getValueKinds());
+	}
+	EXPECT_EQ(second.getDependencies().size(), first.getDependencies().size());
+
+	// editing the header invalidates the cached pragmas
+	std::ofstream(dir + "/kernel.h", std::ios::app) << "static inline void wait() {\n\t#pragma omp taskwait\n}\n";
+	TranslationUnit third(dir + "/main.c", opts);
+	EXPECT_FALSE(third.isCached());
+	EXPECT_EQ(third.getPragmaInfos().size(), (size_t) 3);
+}
+
+TEST(PragmaIndexTest, WriteAndRead) {
+
+	Program prog;
+	prog.addTranslationUnit(std::string(SRC_DIR) + "/inputs/omp_for.c");
+
+	char tmpl[] = "/tmp/clomp_index_XXXXXX";
+	int fd = mkstemp(tmpl);
+	ASSERT_TRUE( fd >= 0 );
+	close(fd);
+	{
+		std::ofstream out(tmpl, std::ios::binary);
+		EXPECT_EQ(writePragmaIndex(out, prog), 4u);
+	}
+
+	PragmaIndex idx(tmpl);
+	ASSERT_EQ(idx.size(), (size_t) 4);
+
+	// #pragma omp parallel for private(a)
+	const index::PragmaEntry& first = *idx.begin();
+	EXPECT_TRUE( idx.getString(first.type) == "omp::parallel" );
+	EXPECT_EQ(idx.getString(first.file).str(), std::string(SRC_DIR) + "/inputs/omp_for.c");
+	EXPECT_EQ(first.line, 6u);
+	EXPECT_EQ(first.targetKind, (uint32_t) index::TARGET_STMT);
+	EXPECT_LT(first.startOffset, first.targetStart);
+
+	bool foundPrivate = false;
+	auto clauses = idx.clauses(first);
+	for (auto it = clauses.first; it != clauses.second; ++it) {
+		if (!(idx.getString(it->key) == "private")) { continue; }
+		foundPrivate = true;
+		auto values = idx.values(*it);
+		ASSERT_EQ(values.second - values.first, 1);
+		EXPECT_EQ(values.first->kind, (uint32_t) index::VALUE_VARIABLE);
+		EXPECT_TRUE( idx.getString(values.first->str) == "a" );
+	}
+	EXPECT_TRUE(foundPrivate);
+
+	unlink(tmpl);
+	EXPECT_THROW( PragmaIndex(std::string(SRC_DIR) + "/inputs/omp_for.c"), IndexError );
+}
+
+TEST(ProgramTest, DetachedTranslationUnit) {
+
+	CompilerOptions opts;
+	opts.detach = true;
+
+	Program prog;
+	TranslationUnit& tu = prog.addTranslationUnit(std::string(SRC_DIR) + "/inputs/omp_for.c", opts);
+	EXPECT_TRUE(tu.isDetached());
+	EXPECT_TRUE(tu.getPragmaList().empty());
+
+	const PragmaInfoList& infos = tu.getPragmaInfos();
+	ASSERT_EQ(infos.size(), (size_t) 4);
+
+	// #pragma omp parallel for private(a)
+	EXPECT_EQ(infos[0].getType(), "omp::parallel");
+	EXPECT_EQ(infos[0].getLine(), 6u);
+	EXPECT_EQ(infos[0].getTargetKind(), PragmaInfo::TARGET_STMT);
+	EXPECT_LT(infos[0].getStartOffset(), infos[0].getTargetStart());
+	ASSERT_EQ(infos[0].getClauses().count("private"), (size_t) 1);
+	EXPECT_EQ(infos[0].getClauses().find("private")->second, std::vector<std::string>(1, "a"));
+	EXPECT_EQ(infos[0].getValueKinds().find("private")->second, 
+			  std::vector<PragmaInfo::ValueKind>(1, PragmaInfo::VALUE_VARIABLE));
+
+	EXPECT_EQ(infos[3].getType(), "omp::barrier");
+}
+
+TEST(ProgramTest, PragmaConsumer) {
+
+	// records the pragmas as they are handed over by the parser
+	struct Collector: public PragmaConsumer {
+		PragmaList pragmas;
+		unsigned attached;
+		bool initialized;
+
+		Collector(): attached(0), initialized(false) { }
+
+		void Initialize(clang::ASTContext&) { initialized = true; }
+
+		void HandlePragma(const PragmaPtr& pragma) {
+			if (pragma->isStatement() || pragma->isDecl()) { ++attached; }
+			pragmas.push_back(pragma);
+		}
+	} collector;
+
+	TranslationUnit tu(std::string(SRC_DIR) + "/inputs/omp_for.c", collector);
+	EXPECT_TRUE(collector.initialized);
+	EXPECT_TRUE(tu.getPragmaList().empty());
+
+	ASSERT_EQ(collector.pragmas.size(), (size_t) 4);
+	EXPECT_EQ(collector.attached, 4u);
+}
+
+TEST(ProgramTest, ParseStats) {
+
+	CompilerOptions opts;
+	opts.collectStats = true;
+
+	Program prog;
+	TranslationUnit& tu = prog.addTranslationUnit(std::string(SRC_DIR) + "/inputs/omp_for.c", opts);
+
+	const ParseStats& stats = tu.getStats();
+	EXPECT_EQ(stats.pragmas, 4u);
+	EXPECT_GT(stats.lineLookups, 0u);
+	EXPECT_GT(stats.parseTime, 0.0);
+	EXPECT_LE(stats.matchTime, stats.parseTime);
+
+	// the collection is disabled by default
+	TranslationUnit& other = prog.addTranslationUnit(std::string(SRC_DIR) + "/inputs/omp_for.c");
+	EXPECT_EQ(other.getStats().pragmas, 0u);
+}
+
+TEST(ProgramTest, MemoryStats) {
+
+	CompilerOptions opts;
+	opts.collectMemory = true;
+	opts.detach = true;
+
+	Program prog;
+	TranslationUnit& tu = prog.addTranslationUnit(std::string(SRC_DIR) + "/inputs/omp_for.c", opts);
+
+	// the figures of the AST are measured before the translation unit is detached
+	const MemoryStats& mem = tu.getMemoryStats();
+	EXPECT_GT(mem.astBytes, 0u);
+	// the clauses of these pragmas fit in the inline storage of the match maps
+	EXPECT_EQ(mem.matchBytes, 0u);
+	EXPECT_GT(mem.pragmaBytes, 4 * sizeof(Pragma));
+	EXPECT_GE(mem.peakRSSDelta, mem.retainedRSSDelta);
+
+	// the library never resets the process-wide peak, a peak reached before building the
+	// translation unit is part of its figure
+	if (MemoryUsage::current().peakRSS == 0) { return; }
+	const size_t size = 64 << 20;
+	void* block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ASSERT_NE(block, MAP_FAILED);
+	std::memset(block, 1, size);
+	munmap(block, size);
+
+	TranslationUnit& other = prog.addTranslationUnit(std::string(SRC_DIR) + "/inputs/omp_for.c", opts);
+	EXPECT_GE(other.getMemoryStats().peakRSSDelta, static_cast<long>(size) / 2);
+}
+
+TEST(ProgramTest, SameLineAssociation) {
+
+	// the pragma and the statements around it share the same line
+	const std::string code = 
+		"void f(int* a) {\n"
+		"	int x = 0, y = 0;\n"
+		"	y++; _Pragma(\"omp critical\") x++;\n"
+		"	a[0] = x + y;\n"
+		"}\n";
+
+	TranslationUnit tu(VirtualFile("same_line.c", code));
+	ASSERT_EQ(tu.getPragmaList().size(), (size_t) 1);
+
+	const PragmaPtr& pragma = tu.getPragmaList().front();
+	ASSERT_TRUE(pragma->isStatement());
+	EXPECT_EQ(tu.describe(*pragma).getTargetStart(), (unsigned) code.find("x++"));
+}
+
+TEST(ProgramTest, TrailingPragmas) {
+
+	const std::string code = 
+		"void f(int* a) {\n"
+		"	#pragma omp parallel\n"
+		"	{\n"
+		"		a[0] = 1;\n"
+		"		a[1] = 2;\n"
+		"		#pragma omp barrier\n"
+		"		#pragma omp flush\n"
+		"	}\n"
+		"}\n";
+
+	CompilerOptions opts;
+	opts.collectStats = true;
+
+	TranslationUnit tu(VirtualFile("trailing.c", code), opts);
+	const PragmaList& pragmas = tu.getPragmaList();
+	ASSERT_EQ(pragmas.size(), (size_t) 3);
+
+	// each trailing pragma gets its own null statement, the block is rebuilt once
+	ASSERT_TRUE(pragmas[1]->isStatement());
+	ASSERT_TRUE(pragmas[2]->isStatement());
+	EXPECT_NE(pragmas[1]->getStatement(), pragmas[2]->getStatement());
+	EXPECT_EQ(tu.getStats().compoundRebuilds, 1u);
+}
+
+namespace {
+
+// connects to the server listening on path, -1 is returned if the connection fails
+int connectTo(const std::string& path) {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool sendAll(int fd, const std::string& data) {
+	return write(fd, data.data(), data.size()) == (ssize_t) data.size();
+}
+
+// reads a response of the server, false if the connection is closed before its end
+bool readResponse(int fd, std::string& status, std::string& payload) {
+	std::string header;
+	char c;
+	while (read(fd, &c, 1) == 1 && c != '\n') { header += c; }
+	size_t sep = header.find(' ');
+	if (sep == std::string::npos) { return false; }
+
+	status = header.substr(0, sep);
+	payload.resize(strtoul(header.c_str() + sep + 1, NULL, 10));
+	for (size_t done = 0; done < payload.size(); ) {
+		ssize_t ret = read(fd, &payload[done], payload.size() - done);
+		if (ret <= 0) { return false; }
+		done += ret;
+	}
+	return true;
+}
+
+// stops the server run by a thread when a check fails before the QUIT request
+struct ServerStopper {
+	const std::string& path;
+	std::thread& runner;
+
+	ServerStopper(const std::string& path, std::thread& runner): path(path), runner(runner) { }
+	~ServerStopper() {
+		if (!runner.joinable()) { return; }
+		int fd = connectTo(path);
+		if (fd >= 0) { 
+			sendAll(fd, "QUIT\n"); 
+			close(fd);
+		}
+		runner.join();
+	}
+};
+
+} // end anonymous namespace
+
+TEST(ServerTest, Requests) {
+
+	char tmpl[] = "/tmp/clomp_server_XXXXXX";
+	ASSERT_TRUE( mkdtemp(tmpl) != NULL );
+	const std::string dir(tmpl);
+	const std::string sock = dir + "/clomp.sock";
+
+	// a file which is not a socket is never replaced
+	std::ofstream(dir + "/main.c") << "int main() { return 0; }\n";
+	EXPECT_THROW( { Server server(dir + "/main.c"); }, ServerError );
+	struct stat st;
+	ASSERT_EQ( stat((dir + "/main.c").c_str(), &st), 0 );
+	EXPECT_TRUE( S_ISREG(st.st_mode) );
+
+	{
+		Server server(sock);
+		std::thread runner([&]() { server.run(); });
+		ServerStopper stopper(sock, runner);
+
+		// the socket of a running server cannot be taken over
+		EXPECT_THROW( { Server other(sock); }, ServerError );
+
+		int fd = connectTo(sock);
+		ASSERT_GE(fd, 0);
+		std::string status, payload;
+
+		ASSERT_TRUE( sendAll(fd, "PING\n") );
+		ASSERT_TRUE( readResponse(fd, status, payload) );
+		EXPECT_EQ(status, "OK");
+		EXPECT_TRUE(payload.empty());
+
+		ASSERT_TRUE( sendAll(fd, "PARSE " + std::string(SRC_DIR) + "/inputs/omp_for.c\n") );
+		ASSERT_TRUE( readResponse(fd, status, payload) );
+		EXPECT_EQ(status, "OK");
+		EXPECT_NE(payload.find("4 OpenMP pragmas\n"), std::string::npos) << payload;
+
+		// the content is framed by its length: the lines it contains are not requests and the
+		// request following it in the same write is served
+		const std::string content = 
+			"void f(void) {\n"
+			"	#pragma omp barrier\n"
+			"}\n"
+			"// QUIT\n";
+		std::ostringstream req;
+		req << "PARSE_BUFFER " << content.size() << " " << dir << "/unsaved.c\n" << content << "PING\n";
+		ASSERT_TRUE( sendAll(fd, req.str()) );
+		ASSERT_TRUE( readResponse(fd, status, payload) );
+		EXPECT_EQ(status, "OK");
+		EXPECT_NE(payload.find("1 OpenMP pragmas\n"), std::string::npos) << payload;
+		ASSERT_TRUE( readResponse(fd, status, payload) );
+		EXPECT_EQ(status, "OK");
+		EXPECT_TRUE(payload.empty());
+
+		ASSERT_TRUE( sendAll(fd, "HELLO\n") );
+		ASSERT_TRUE( readResponse(fd, status, payload) );
+		EXPECT_EQ(status, "ERR");
+		EXPECT_NE(payload.find("unknown request"), std::string::npos) << payload;
+
+		ASSERT_TRUE( sendAll(fd, "QUIT\n") );
+		ASSERT_TRUE( readResponse(fd, status, payload) );
+		EXPECT_EQ(status, "OK");
+		runner.join();
+		close(fd);
+	}
+	// the socket is removed once the server is gone
+	EXPECT_NE( lstat(sock.c_str(), &st), 0 );
+}
+
+namespace {
+
+// writes a compilation database into a temporary file and reads it back
+CompileCommandList loadDatabase(const std::string& json) {
+	char tmpl[] = "/tmp/clomp_compdb_XXXXXX";
+	int fd = mkstemp(tmpl);
+	if (fd < 0) { throw CompilationDatabaseError("unable to create a temporary file"); }
+	close(fd);
+	std::ofstream(tmpl) << json;
+
+	struct Remove {
+		const char* path;
+		~Remove() { unlink(path); }
+	} remove = { tmpl };
+	return loadCompilationDatabase(tmpl);
+}
+
+} // end anonymous namespace
+
+TEST(CompilationDatabaseTest, Reader) {
+
+	const CompileCommandList&& cmds = loadDatabase(
+		"[\n"
+		"  { \"directory\": \"/work\", \"file\": \"a\\u00e9\\ud83d\\ude00.c\", \"command\": \"cc -c a.c\",\n"
+		"    \"output\": { \"nested\": [1, -2.5e3, true, null, \"x\"] }, \"extra\": false },\n"
+		"  { \"arguments\": [\"cc\", \"-c\"], \"file\": \"q\\\"\\\\\\/\\t.c\", \"directory\": \"/work\" }\n"
+		"]\n");
+	ASSERT_EQ(cmds.size(), (size_t) 2);
+
+	// \\u escapes are encoded as UTF-8, surrogate pairs included
+	EXPECT_EQ(cmds[0].file, "a\xc3\xa9\xf0\x9f\x98\x80.c");
+	EXPECT_EQ(cmds[0].directory, "/work");
+	ASSERT_EQ(cmds[0].arguments.size(), (size_t) 3);
+	EXPECT_EQ(cmds[0].arguments[2], "a.c");
+
+	EXPECT_EQ(cmds[1].file, "q\"\\/\t.c");
+	ASSERT_EQ(cmds[1].arguments.size(), (size_t) 2);
+	EXPECT_EQ(cmds[1].arguments[1], "-c");
+
+	EXPECT_TRUE( loadDatabase(" [ ] ").empty() );
+	EXPECT_THROW( loadDatabase("[] x"), CompilationDatabaseError );
+	EXPECT_THROW( loadDatabase("[{\"file\": \"a.c\"}] []"), CompilationDatabaseError );
+	EXPECT_THROW( loadDatabase("[{\"file\": \"a.c\"}"), CompilationDatabaseError );
+	EXPECT_THROW( loadDatabase("[{\"file\": \"a.c}]"), CompilationDatabaseError );
+	EXPECT_THROW( loadDatabase("[{\"directory\": \"/work\"}]"), CompilationDatabaseError );
+	EXPECT_THROW( loadCompilationDatabase("/nonexistent/compile_commands.json"), CompilationDatabaseError );
+}
+
+TEST(CompilationDatabaseTest, SplitCommandLine) {
+
+	const std::vector<std::string>&& args = splitCommandLine(
+		" cc  -DMSG=\"hello world\"\t'single \\ \"quoted\"' a\\ b \"esc \\\" \\\\ \\$ \\n\" '' -c ");
+	ASSERT_EQ(args.size(), (size_t) 7);
+	EXPECT_EQ(args[0], "cc");
+	EXPECT_EQ(args[1], "-DMSG=hello world");
+	// nothing is escaped within single quotes
+	EXPECT_EQ(args[2], "single \\ \"quoted\"");
+	EXPECT_EQ(args[3], "a b");
+	// within double quotes the backslash only escapes ", \\, $ and `
+	EXPECT_EQ(args[4], "esc \" \\ $ \\n");
+	EXPECT_EQ(args[5], "");
+	EXPECT_EQ(args[6], "-c");
+
+	EXPECT_TRUE( splitCommandLine(" \t ").empty() );
+}
+
+TEST(CompilationDatabaseTest, CompilerOptions) {
+
+	CompileCommand cmd;
+	cmd.directory = "/work";
+	cmd.file = "src/a.c";
+	const char* const args[] = { 
+		"cc", "-Iinc", "-I", "/abs/inc", "-isystem", "sys", "-isystemsys2", "-iquote", "q", "-iquoteq2",
+		"-DA=1", "-D", "B", "-UC", "-U", "D", "-c", "src/a.c" 
+	};
+	cmd.arguments.assign(args, args + sizeof(args)/sizeof(args[0]));
+	EXPECT_EQ(cmd.getFilePath(), "/work/src/a.c");
+
+	const CompilerOptions&& opts = cmd.getCompilerOptions();
+	ASSERT_EQ(opts.includePaths.size(), (size_t) 2);
+	EXPECT_EQ(opts.includePaths[0], "/work/inc");
+	EXPECT_EQ(opts.includePaths[1], "/abs/inc");
+	ASSERT_EQ(opts.systemIncludePaths.size(), (size_t) 2);
+	EXPECT_EQ(opts.systemIncludePaths[0], "/work/sys");
+	EXPECT_EQ(opts.systemIncludePaths[1], "/work/sys2");
+	ASSERT_EQ(opts.quoteIncludePaths.size(), (size_t) 2);
+	EXPECT_EQ(opts.quoteIncludePaths[0], "/work/q");
+	EXPECT_EQ(opts.quoteIncludePaths[1], "/work/q2");
+	ASSERT_EQ(opts.definitions.size(), (size_t) 2);
+	EXPECT_EQ(opts.definitions[0], "A=1");
+	EXPECT_EQ(opts.definitions[1], "B");
+	ASSERT_EQ(opts.undefinitions.size(), (size_t) 2);
+	EXPECT_EQ(opts.undefinitions[0], "C");
+	EXPECT_EQ(opts.undefinitions[1], "D");
+
+	// the "arguments" form has precedence over "command", whichever comes first
+	const CompileCommandList&& cmds = loadDatabase(
+		"[ { \"directory\": \"/work\", \"file\": \"a.c\", \"command\": \"cc -Icmd\", \"arguments\": [\"cc\", \"-Iargs\"] },\n"
+		"  { \"directory\": \"/work\", \"file\": \"b.c\", \"arguments\": [\"cc\", \"-Iargs\"], \"command\": \"cc -Icmd\" } ]");
+	ASSERT_EQ(cmds.size(), (size_t) 2);
+	for (auto it = cmds.begin(), end = cmds.end(); it != end; ++it) {
+		const CompilerOptions&& cur = it->getCompilerOptions();
+		ASSERT_EQ(cur.includePaths.size(), (size_t) 1);
+		EXPECT_EQ(cur.includePaths[0], "/work/args");
+	}
+}
+
+TEST(BatchDriverTest, Workers) {
+
+	char tmpl[] = "/tmp/clomp_batch_XXXXXX";
+	ASSERT_TRUE( mkdtemp(tmpl) != NULL );
+	const std::string dir(tmpl);
+	std::ofstream(dir + "/invalid.c") << "int main( {\n";
+
+	std::vector<BatchEntry> entries;
+	entries.push_back( BatchEntry(std::string(SRC_DIR) + "/inputs/omp_parallel.c") );
+	entries.push_back( BatchEntry(std::string(SRC_DIR) + "/inputs/omp_for.c") );
+	entries.push_back( BatchEntry(dir + "/invalid.c") );
+	entries.push_back( BatchEntry(std::string(SRC_DIR) + "/inputs/no_omp.c") );
+	entries.push_back( BatchEntry(std::string(SRC_DIR) + "/inputs/omp_parallel.c") );
+
+	std::ostringstream workers;
+	EXPECT_EQ( BatchDriver(entries, 2).run(workers), 1u );
+	const std::string&& out = workers.str();
+
+	// the reports follow the order of the input list, whichever worker parsed the file
+	size_t pos = 0;
+	for (auto it = entries.begin(), end = entries.end(); it != end; ++it) {
+		size_t next = out.find(it->file + "\n", pos);
+		ASSERT_NE(next, std::string::npos) << out;
+		pos = next + it->file.size();
+	}
+	EXPECT_NE(out.find("error: unable to parse translation unit"), std::string::npos) << out;
+
+	// the output is the same produced by the current process
+	std::ostringstream inProcess;
+	EXPECT_EQ( BatchDriver(entries, 0).run(inProcess), 1u );
+	EXPECT_EQ(out, inProcess.str());
+}